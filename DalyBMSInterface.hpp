@@ -10,6 +10,21 @@
 #include "src/DalyBMSRequestResponseTypes.hpp"
 #include "src/DalyBMSManager.hpp"
 #include "src/DalyBMSConnector.hpp"
+#include "src/DalyBMSStore.hpp"
+#include "src/DalyBMSCalibration.hpp"
+#include "src/DalyBMSDiscovery.hpp"
+#include "src/DalyBMSCache.hpp"
+#include "src/DalyBMSPolling.hpp"
+#include "src/DalyBMSRecorder.hpp"
+#include "src/DalyBMSAlarms.hpp"
+#include "src/DalyBMSThresholds.hpp"
+#include "src/DalyBMSRules.hpp"
+#include "src/DalyBMSSnapshot.hpp"
+#include "src/DalyBMSFusion.hpp"
+#include "src/DalyBMSBank.hpp"
+#include "src/DalyBMSFleet.hpp"
+#include "src/DalyBMSConnectorPosix.hpp"
+#include "src/DalyBMSConnectorCan.hpp"
 #include "src/DalyBMSConverterDebug.hpp"
 #include "src/DalyBMSConverterJson.hpp"
 #include "src/DalyBMSInterface.hpp"
@@ -0,0 +1,180 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// the little of the Arduino core (and of the debug/utility libraries main.cpp builds with) that the
+// library uses, on a Linux host, so that the Linux parts can be built and tested without a board
+
+#pragma once
+
+// the standard headers the board's Arduino.h brings in, which the library includes inside its
+// namespace expecting them already included
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define HEX 16
+
+class String {
+    std::string _string;
+
+public:
+    String () { }
+    String (const char *string) :
+        _string (string != nullptr ? string : "") { }
+    String (const std::string &string) :
+        _string (string) { }
+    explicit String (const char character) :
+        _string (1, character) { }
+    String (const int value, const unsigned char base = 10) :
+        _string (format (base == HEX ? "%x" : "%d", value)) { }
+    String (const unsigned value, const unsigned char base = 10) :
+        _string (format (base == HEX ? "%x" : "%u", value)) { }
+    String (const long value, const unsigned char base = 10) :
+        _string (format (base == HEX ? "%lx" : "%ld", value)) { }
+    String (const unsigned long value, const unsigned char base = 10) :
+        _string (format (base == HEX ? "%lx" : "%lu", value)) { }
+    String (const unsigned char value, const unsigned char base = 10) :
+        String (static_cast<unsigned> (value), base) { }
+    String (const float value, const unsigned char places = 2) :
+        _string (format ("%.*f", places, static_cast<double> (value))) { }
+    String (const double value, const unsigned char places = 2) :
+        _string (format ("%.*f", places, value)) { }
+
+    const char *c_str () const {
+        return _string.c_str ();
+    }
+    unsigned length () const {
+        return static_cast<unsigned> (_string.size ());
+    }
+    bool isEmpty () const {
+        return _string.empty ();
+    }
+    void trim () {
+        const auto first = _string.find_first_not_of (" \t\r\n"), last = _string.find_last_not_of (" \t\r\n");
+        _string = first == std::string::npos ? std::string () : _string.substr (first, last - first + 1);
+    }
+    bool startsWith (const String &prefix) const {
+        return _string.rfind (prefix._string, 0) == 0;
+    }
+    char operator[] (const unsigned index) const {
+        return _string [index];
+    }
+    String &operator+= (const String &other) {
+        _string += other._string;
+        return *this;
+    }
+    String &operator+= (const char *other) {
+        _string += other;
+        return *this;
+    }
+    String &operator+= (const char other) {
+        _string += other;
+        return *this;
+    }
+    friend String operator+ (const String &a, const String &b) {
+        return String (a._string + b._string);
+    }
+    friend String operator+ (const String &a, const char *b) {
+        return String (a._string + b);
+    }
+    friend String operator+ (const char *a, const String &b) {
+        return String (a + b._string);
+    }
+    bool operator== (const String &other) const {
+        return _string == other._string;
+    }
+    bool operator!= (const String &other) const {
+        return _string != other._string;
+    }
+
+private:
+    template <typename... ARGS>
+    static std::string format (const char *format, ARGS... args) {
+        char buffer [64];
+        std::snprintf (buffer, sizeof (buffer), format, args...);
+        return buffer;
+    }
+};
+
+inline unsigned long millis () {
+    static const auto started = std::chrono::steady_clock::now ();
+    return static_cast<unsigned long> (std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now () - started).count ());
+}
+inline unsigned long micros () {
+    static const auto started = std::chrono::steady_clock::now ();
+    return static_cast<unsigned long> (std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now () - started).count ());
+}
+inline void delay (const unsigned long ms) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (ms));
+}
+
+struct HostSerial {
+    void begin (unsigned long) { }
+    void end () { }
+    void flush () {
+        std::fflush (stdout);
+    }
+    template <typename... ARGS>
+    int printf (const char *format, ARGS... args) {
+        return std::printf (format, args...);
+    }
+};
+inline HostSerial Serial;
+
+// -----------------------------------------------------------------------------------------------
+
+typedef unsigned long interval_t;
+typedef unsigned long counter_t;
+
+class ActivationTracker {
+    unsigned long _seconds {};
+    counter_t _count {};
+
+public:
+    ActivationTracker &operator++ (int) {
+        _seconds = millis () / 1000;
+        _count++;
+        return *this;
+    }
+    interval_t seconds () const {
+        return _seconds;
+    }
+    counter_t count () const {
+        return _count;
+    }
+};
+
+class Enableable {
+    bool _enabled {};
+
+public:
+    operator bool () const {
+        return _enabled;
+    }
+    Enableable &operator++ (int) {
+        _enabled = true;
+        return *this;
+    }
+};
+
+#define DEBUG_PRINTF Serial.printf
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
@@ -0,0 +1,439 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// tests of the Linux connectors (pty, reactor, worker thread, SocketCAN) against the simulator,
+// built on the host with `make` and run with `make test`: see the Makefile
+
+#include <Arduino.h>
+
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSRequestResponse.hpp"
+#include "DalyBMSRequestResponseTypes.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSConnectorPosix.hpp"
+#include "DalyBMSConnectorCan.hpp"
+#include "DalyBMSSimulator.hpp"
+#include "DalyBMSConverterDebug.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------------------------
+
+// a failed check is printed and counted, and main () exits with failure if any did
+
+static int checksFailed = 0;
+
+bool check (const char *test, const bool condition, const char *claim) {
+    if (! condition) {
+        DEBUG_PRINTF ("%s: CHECK FAILED: %s\n", test, claim);
+        checksFailed++;
+    }
+    return condition;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testPosix () {
+
+    daly_bms::Simulator simulator;
+    auto port = std::make_unique<daly_bms::PosixSimulatorPort> (simulator);
+    const daly_bms::PosixConnector::Config connectorConfig = { .device = port->device () };
+    daly_bms::PosixConnector connector (connectorConfig);
+    const daly_bms::ManagerConfig config = {
+        .id = "posix",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::Errors
+    };
+    daly_bms::Manager manager (config, connector);
+    manager.begin ();
+
+    const auto exchange = [&] (const auto &request) {
+        request ();
+        port->serve ();
+        while (connector.await (50))
+            ;
+    };
+    exchange ([&] () { manager.requestInitial (); });
+    exchange ([&] () { manager.requestConditions (); });
+    exchange ([&] () { manager.requestDiagnostics (); });
+
+    DEBUG_PRINTF ("posix<%s>: received=%lu, badframes=%lu, cells=%u\n", connectorConfig.device.c_str (), manager.getStatus ().received.count (), manager.getStatus ().badframes.count (), static_cast<unsigned> (manager.diagnostics.voltages.values.size ()));
+    check ("posix", connector.isOpen () && manager.getStatus ().received.count () > 0 && manager.getStatus ().badframes.count () == 0, "frames received through the pty, none bad");
+    check ("posix", manager.conditions.status.isValid () && manager.diagnostics.voltages.values.size () == simulator.state.cellVoltagesMv.size (), "responses decoded, all cells present");
+    debugDump (manager);
+
+    // the device unplugged: the connector closes on the hang up rather than failing every read, and
+    // a reactor drops the port rather than being woken by it on every wait
+    port.reset ();
+    check ("posix", connector.await (50) && ! connector.isOpen () && ! connector.await (50), "the connector closed once the device hung up");
+    port = std::make_unique<daly_bms::PosixSimulatorPort> (simulator);
+    const daly_bms::PosixConnector::Config reactedConfig = { .device = port->device () };
+    daly_bms::PosixConnector reacted (reactedConfig);
+    daly_bms::Manager reactedManager (config, reacted);
+    reactedManager.begin ();
+    daly_bms::PosixReactor reactor;
+    reactor.add (reacted, reactedManager);
+    port.reset ();
+    const unsigned long started = millis ();
+    while (millis () - started < 250)
+        reactor.runOnce (50);
+    const auto &statistics = reactor.getStatistics ();
+    DEBUG_PRINTF ("posix: hung up, reactor wakes=%u, dispatches=%u, hangups=%u\n", statistics.wakes, statistics.dispatches, statistics.hangups);
+    check ("posix", statistics.hangups == 1 && statistics.wakes < 20 && ! reacted.isOpen (), "the reactor removed the port once it hung up");
+    reactedManager.end ();
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// N pty-backed simulators served from their own thread and reactor; the gateway reactor polls every
+// pack each period, staggered, and reports its own thread CPU per pack-cycle and the timer jitter
+
+void testReactor () {
+
+    constexpr uint32_t period = 250, duration = 2000;
+    const auto measure = [&] (const size_t count) {
+        const daly_bms::ManagerConfig config = {
+            .id = "reactor",
+            .capabilities = daly_bms::Capabilities::Managing,
+            .categories = daly_bms::Categories::Conditions,
+            .debugging = daly_bms::Debugging::None
+        };
+        std::vector<std::unique_ptr<daly_bms::Simulator>> simulators;
+        std::vector<std::unique_ptr<daly_bms::PosixSimulatorPort>> ports;
+        std::vector<daly_bms::PosixConnector::Config> connectorConfigs;
+        std::vector<std::unique_ptr<daly_bms::PosixConnector>> connectors;
+        std::vector<std::unique_ptr<daly_bms::Manager>> managers;
+        daly_bms::PosixReactor gateway, devices;
+        connectorConfigs.reserve (count);
+        for (size_t i = 0; i < count; i++) {
+            simulators.push_back (std::make_unique<daly_bms::Simulator> ());
+            ports.push_back (std::make_unique<daly_bms::PosixSimulatorPort> (*simulators.back ()));
+            connectorConfigs.push_back ({ .device = ports.back ()->device () });
+            connectors.push_back (std::make_unique<daly_bms::PosixConnector> (connectorConfigs.back ()));
+            managers.push_back (std::make_unique<daly_bms::Manager> (config, *connectors.back ()));
+            managers.back ()->begin ();
+            devices.add (ports.back ()->fd (), daly_bms::PosixReactor::Action::bind<&daly_bms::PosixSimulatorPort::serve> (ports.back ().get ()));
+            gateway.add (*connectors.back (), *managers.back ());
+            gateway.schedule<&daly_bms::Manager::requestConditions> (static_cast<uint32_t> (i * period / count), *managers.back (), period);
+        }
+        std::atomic<bool> running { true };
+        std::thread serving ([&] () {
+            while (running)
+                devices.runOnce (10);
+        });
+        struct timespec cpuStart, cpuEnd;
+        ::clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+        const daly_bms::PosixReactor::Ticks end = daly_bms::PosixReactor::now () + duration * 1000;
+        while (daly_bms::PosixReactor::now () < end)
+            gateway.runOnce (std::max (1, static_cast<int> ((end - daly_bms::PosixReactor::now ()) / 1000)));
+        ::clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+        running = false;
+        serving.join ();
+        unsigned long received = 0, silent = 0;
+        for (const auto &manager : managers)
+            received += manager->getStatus ().received.count (), silent += manager->getStatus ().received.count () == 0 ? 1 : 0;
+        const auto &statistics = gateway.getStatistics ();
+        const double cpu = (cpuEnd.tv_sec - cpuStart.tv_sec) * 1e6 + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1e3;
+        DEBUG_PRINTF ("reactor<%zu>: cycles=%u, received=%lu, cpu/pack-cycle=%.1fus, jitter mean=%lldus max=%lldus, wakes=%u, dispatches=%u\n",
+                      count, statistics.timers, received, statistics.timers ? cpu / statistics.timers : 0.0,
+                      static_cast<long long> (statistics.jitterMean ()), static_cast<long long> (statistics.jitterMax), statistics.wakes, statistics.dispatches);
+        check ("reactor", silent == 0, "every pack answered");
+        check ("reactor", statistics.timers >= count * (duration / period) - count, "every pack polled each period");
+    };
+
+    for (const size_t count : { 1, 4, 16, 64, 256 })
+        measure (count);
+
+    // a pack that never answers: nothing is dispatched for its port, so only its manager's timer,
+    // re-armed after each scheduled request, times out what was sent
+    const daly_bms::ManagerConfig silentConfig = {
+        .id = "silent",
+        .capabilities = daly_bms::Capabilities::Managing,
+        .categories = daly_bms::Categories::Conditions,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::Simulator simulator;
+    simulator.state.unanswered = { 0x90, 0x91, 0x92, 0x93, 0x94, 0x98 };
+    daly_bms::PosixSimulatorPort port (simulator);
+    const daly_bms::PosixConnector::Config connectorConfig = { .device = port.device () };
+    daly_bms::PosixConnector connector (connectorConfig);
+    daly_bms::Manager manager (silentConfig, connector);
+    manager.begin ();
+    daly_bms::PosixReactor gateway, device;
+    device.add (port.fd (), daly_bms::PosixReactor::Action::bind<&daly_bms::PosixSimulatorPort::serve> (&port));
+    gateway.add (connector, manager);
+    gateway.schedule<&daly_bms::Manager::requestConditions> (0, manager, period);
+    const daly_bms::PosixReactor::Ticks end = daly_bms::PosixReactor::now () + duration * 1000;
+    while (daly_bms::PosixReactor::now () < end)
+        gateway.runOnce (10), device.runOnce (0);
+    DEBUG_PRINTF ("reactor<silent>: sent=%lu, timeouts=%lu, received=%lu\n", manager.getStatus ().sent.count (), manager.getStatus ().timeouts.count (), manager.getStatus ().received.count ());
+    check ("reactor", manager.getStatus ().received.count () == 0 && manager.getStatus ().timeouts.count () > 0, "requests to a silent pack timed out by the re-armed timer");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// reading deferred to a worker thread: a deliberately slow handler on the application thread
+// delays dispatch but never the draining of the port, so nothing is lost while it runs; lazily
+// retained frames decode on the application thread, and decoding them from another is asserted
+
+void testConcurrent () {
+
+    struct SlowHandler : daly_bms::Manager::Handler {
+        int handled = 0;
+        bool handle (daly_bms::RequestResponse &) override {
+            handled++;
+            delay (2);
+            return false;
+        }
+    } slow;
+    daly_bms::Simulator simulator;
+    daly_bms::PosixSimulatorPort port (simulator);
+    const daly_bms::PosixConnector::Config connectorConfig = { .device = port.device () };
+    daly_bms::PosixConnector connector (connectorConfig);
+    const daly_bms::ManagerConfig config = {
+        .id = "concurrent",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::Errors,
+        .lazy = daly_bms::Categories::Diagnostics
+    };
+    daly_bms::Manager manager (config, connector);
+    manager.subscribe (&slow, daly_bms::Categories::All);
+    daly_bms::PosixConnector::Queue queue;
+    connector.defer (&queue);
+    manager.begin ();
+
+    std::atomic<bool> running { true };
+    std::thread device ([&] () {
+        while (running) {
+            port.serve ();
+            delay (1);
+        }
+    });
+    std::thread worker ([&] () {
+        while (running)
+            connector.await (5);
+    });
+    for (int cycle = 0; cycle < 20; cycle++) {
+        manager.requestConditions ();
+        manager.requestDiagnostics ();
+        delay (20);
+        manager.process ();
+    }
+    delay (100);
+    manager.process ();
+    running = false;
+    device.join ();
+    worker.join ();
+    DEBUG_PRINTF ("concurrent: received=%lu, handled=%d, overflows=%u\n", manager.getStatus ().received.count (), slow.handled, static_cast<unsigned> (queue.overflows ()));
+    check ("concurrent", queue.overflows () == 0 && manager.getStatus ().badframes.count () == 0, "the worker drained every frame while the handler was slow");
+    check ("concurrent", manager.getStatus ().received.count () > 0 && static_cast<unsigned long> (slow.handled) == manager.getStatus ().received.count (), "every frame received was dispatched on the application thread");
+    const pid_t child = fork ();
+    if (child == 0) {
+        std::freopen ("/dev/null", "w", stderr);
+        std::thread reader ([&] () {
+            manager.diagnostics.voltages.decode ();
+        });
+        reader.join ();
+        _exit (EXIT_SUCCESS);
+    }
+    int childStatus = 0;
+    waitpid (child, &childStatus, 0);
+    check ("concurrent", WIFSIGNALED (childStatus) && WTERMSIG (childStatus) == SIGABRT, "a lazy decode off the dispatching thread was asserted");
+    check ("concurrent", manager.diagnostics.voltages.decode (), "a lazy decode on the dispatching thread succeeded");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// reader thread draining into the byte ring while the application sleeps between process () calls,
+// as it would in processInterval.wait (); reports the ring high-water mark against its capacity
+
+void testBuffered () {
+
+    daly_bms::Simulator simulator;
+    simulator.state.cellVoltagesMv.assign (32, 3300);
+    daly_bms::PosixSimulatorPort port (simulator);
+    const daly_bms::PosixConnector::Config connectorConfig = { .device = port.device () };
+    daly_bms::BufferedConnector<daly_bms::PosixConnector> connector (connectorConfig);
+    const daly_bms::ManagerConfig config = {
+        .id = "buffered",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::Errors
+    };
+    daly_bms::Manager manager (config, connector);
+    manager.begin ();
+
+    std::atomic<bool> running { true };
+    std::thread device ([&] () {
+        while (running) {
+            port.serve ();
+            delay (1);
+        }
+    });
+    for (int cycle = 0; cycle < 10; cycle++) {
+        manager.requestInitial ();
+        manager.requestConditions ();
+        manager.requestDiagnostics ();
+        delay (200);
+        manager.process ();
+    }
+    running = false;
+    device.join ();
+    DEBUG_PRINTF ("buffered: received=%lu, badframes=%lu, high-water=%u of %u, overflows=%u\n", manager.getStatus ().received.count (), manager.getStatus ().badframes.count (),
+                  static_cast<unsigned> (connector.highWater ()), static_cast<unsigned> (DALYBMS_RING_RX), static_cast<unsigned> (connector.overflows ()));
+    check ("buffered", manager.getStatus ().received.count () > 0 && manager.getStatus ().badframes.count () == 0 && connector.overflows () == 0, "the reader absorbed every burst while the application slept");
+    check ("buffered", connector.highWater () > 0 && connector.highWater () <= DALYBMS_RING_RX, "bytes waited in the ring, within its capacity");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// a simulated pack on vcan0 (set up by `make vcan`) polled as fast as it answers, against the same
+// over a 9600 baud UART line, then streaming unasked. vcan has no bit timing, so its rate bounds the
+// host side: a 250 kbit/s bus adds ~0.5ms per frame
+
+void testCan () {
+
+    // the identifier layout and the kernel filter, which need no interface: every response from
+    // pack 1 to the host passes, and nothing else does
+    using daly_bms::CanProtocol;
+    check ("can", CanProtocol::identifier (0x90, CanProtocol::ADDRESS_BMS, CanProtocol::ADDRESS_HOST) == (CAN_EFF_FLAG | 0x18900140u) && CanProtocol::identifier (0x90, CanProtocol::ADDRESS_HOST, CanProtocol::ADDRESS_BMS) == (CAN_EFF_FLAG | 0x18904001u), "identifiers as priority, command, destination, source");
+    const struct can_filter filter = CanProtocol::filter (CanProtocol::ADDRESS_BMS, CanProtocol::ADDRESS_HOST);
+    daly_bms::Simulator simulator;
+    daly_bms::Simulator::Frames frames;
+    size_t translated = 0;
+    for (uint8_t command = 0x90; command <= 0x98; command++) {
+        const canid_t response = CanProtocol::identifier (command, CanProtocol::ADDRESS_HOST, CanProtocol::ADDRESS_BMS);
+        check ("can", CanProtocol::matches (filter, response) && CanProtocol::command (response) == command, "a response from the pack passes the filter, any command");
+        check ("can", ! CanProtocol::matches (filter, CanProtocol::identifier (command, CanProtocol::ADDRESS_BMS, CanProtocol::ADDRESS_HOST)) && ! CanProtocol::matches (filter, CanProtocol::identifier (command, CanProtocol::ADDRESS_HOST, 0x02)) && ! CanProtocol::matches (filter, response | CAN_RTR_FLAG) && ! CanProtocol::matches (filter, response & CAN_SFF_MASK), "requests, other packs, remote and standard frames do not");
+        daly_bms::RequestResponseFrame request;
+        request.setCommand (command);
+        frames.clear ();
+        simulator.respond (request, frames);
+        for (const auto &frame : frames) {    // as the pack sends it, and as the connector hands it on
+            const struct can_frame carried = CanProtocol::toCan (frame.getCommand (), CanProtocol::ADDRESS_HOST, CanProtocol::ADDRESS_BMS, frame.data () + daly_bms::RequestResponseFrame::Constants::SIZE_HEADER);
+            daly_bms::RequestResponseFrame received;
+            if (CanProtocol::matches (filter, carried.can_id) && CanProtocol::fromCan (carried, received) && received.valid () && std::memcmp (received.data (), frame.data (), frame.size ()) == 0)
+                translated++;
+        }
+    }
+    check ("can", translated > 9, "every response frame carried over CAN arrives as the UART frame");
+
+    // a manager on the CAN connector configures only what CAN carries, whatever its capabilities,
+    // rather than sending the others to time out
+    const daly_bms::ManagerConfig everything = {
+        .id = "can",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    const daly_bms::CanConnector::Config unopenedConfig = { .interface = "vcan0" };
+    daly_bms::CanConnector unopened (unopenedConfig);
+    daly_bms::Manager restricted (everything, unopened);
+    size_t carried = 0, uncarried = 0;
+    restricted.forEachEnabledComponent (daly_bms::Categories::All, [&] (const daly_bms::Categories, daly_bms::RequestResponse &component) {
+        (CanProtocol::carries (component.getCommand ()) ? carried : uncarried)++;
+    });
+    check ("can", carried == 9 && uncarried == 0, "0x90 to 0x98 configured, nothing else");
+
+    constexpr unsigned long duration = 2000;
+    const daly_bms::ManagerConfig config = {
+        .id = "can",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::Conditions,
+        .debugging = daly_bms::Debugging::Errors
+    };
+    const auto measure = [&] (daly_bms::Manager &manager, const auto &cycle) {
+        const unsigned long before = manager.getStatus ().received.count (), start = millis ();
+        while (millis () - start < duration) {
+            cycle ();
+            manager.process ();
+        }
+        return static_cast<double> (manager.getStatus ().received.count () - before) * 1000.0 / duration;
+    };
+
+    daly_bms::SimulatorConnector uartConnector (simulator, daly_bms::SimulatorConnector::Line { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager uart (config, uartConnector);
+    uart.begin ();
+    const double uartRate = measure (uart, [&] () {
+        if (uart.isIdle ())
+            uart.requestConditions ();
+    });
+    uart.end ();
+
+    daly_bms::CanSimulatorPort port (simulator, "vcan0");
+    const daly_bms::CanConnector::Config connectorConfig = { .interface = "vcan0" };
+    daly_bms::CanConnector connector (connectorConfig);
+    daly_bms::Manager can (config, connector);
+    can.begin ();
+    check ("can", uartRate > 0.0, "the UART line answered");
+    if (! port.isOpen () || ! connector.isOpen ()) {
+        DEBUG_PRINTF ("can: vcan0 not available, not measured (see make vcan)\n");
+        return;
+    }
+    const double polledRate = measure (can, [&] () {
+        if (can.isIdle ())
+            can.requestConditions ();
+        port.serve ();
+        connector.await (1);
+    });
+    unsigned long broadcastAt = 0;
+    const double streamedRate = measure (can, [&] () {
+        if (millis () - broadcastAt >= 10) {
+            broadcastAt = millis ();
+            port.broadcast ({ 0x90, 0x91, 0x92, 0x93, 0x94, 0x98 });
+        }
+        connector.await (1);
+    });
+    const auto &statistics = connector.getStatistics ();
+    DEBUG_PRINTF ("can: responses/s uart=%.0f, can polled=%.0f (x%.0f), can streamed=%.0f; transmitted=%lu, received=%lu, rejected=%lu, badframes=%lu\n",
+                  uartRate, polledRate, uartRate > 0.0 ? polledRate / uartRate : 0.0, streamedRate,
+                  static_cast<unsigned long> (statistics.transmitted), static_cast<unsigned long> (statistics.received), static_cast<unsigned long> (statistics.rejected), can.getStatus ().badframes.count ());
+    check ("can", polledRate > uartRate && streamedRate > 0.0 && statistics.rejected == 0 && can.getStatus ().badframes.count () == 0, "responses through vcan0, faster than the UART, none rejected");
+    debugDump (can);
+    can.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+int main (int argc, char **argv) {
+
+    const struct {
+        const char *name;
+        void (*test) ();
+    } tests [] = {
+        { "posix", testPosix },
+        { "reactor", testReactor },
+        { "concurrent", testConcurrent },
+        { "buffered", testBuffered },
+        { "can", testCan },
+    };
+    for (const auto &test : tests) {
+        bool selected = argc < 2;
+        for (int arg = 1; arg < argc; arg++)
+            selected |= std::strcmp (argv [arg], test.name) == 0;
+        if (selected)
+            test.test ();
+    }
+    if (checksFailed > 0)
+        DEBUG_PRINTF ("*** %d CHECKS FAILED\n", checksFailed);
+    return checksFailed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
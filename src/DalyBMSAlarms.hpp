@@ -0,0 +1,214 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSStore.hpp"
+#endif
+
+#include <array>
+#include <ctime>
+#include <vector>
+
+#ifndef DALYBMS_ALARMS_JOURNAL
+#define DALYBMS_ALARMS_JOURNAL 64    // events held, the oldest overwritten
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct AlarmEvent {
+    enum class Kind : uint8_t {
+        Raised,
+        Cleared
+    };
+    uint32_t time;    // from the journal's clock, seconds
+    uint8_t code;     // failure bit, see RequestResponse_FAILURE::getFailureDescription ()
+    Kind kind;
+    const char *description () const {
+        return RequestResponse_FAILURE::getFailureDescription (code);
+    }
+};
+
+// turns the FAILURE bits into debounced raised/cleared events: a bit must be seen set in
+// `raise` consecutive responses to be raised, and stay clear for `clear` milliseconds to be
+// cleared (hysteresis, so a flickering alarm stays raised). Events are kept in a fixed journal,
+// queryable by codes and time, persisted to a Store when changed, and passed to handlers. Work is
+// per changed or pending bit: when nothing changes, a response costs a compare
+
+template <typename MANAGER, size_t CAPACITY = DALYBMS_ALARMS_JOURNAL>
+class AlarmJournal : public Handlerable<const AlarmEvent &> {
+    static_assert (CAPACITY <= 0xFF, "journal length is stored in a byte");
+
+public:
+    static constexpr size_t CODES = RequestResponse_FAILURE::CODES;
+    static constexpr uint64_t ALL = (uint64_t { 1 } << CODES) - 1;
+
+    struct Config {
+        uint8_t raise { 2 };                          // consecutive responses with the bit set
+        SystemTicks_t clear { 10000 };                // continuously clear
+        uint32_t (*clock) () { &AlarmJournal::now };    // event time, e.g. epoch seconds once NTP has set them
+        const char *prefix { "alarms" };
+    };
+
+    AlarmJournal (MANAGER &manager, const Config &config = Config ()) :
+        _manager (manager),
+        _config (config) {
+        if constexpr (! is_request_response_disabled<decltype (_manager.conditions.failure)>::value)
+            _subscribed = _manager.template subscribe<&AlarmJournal::handleFailure> (this, _manager.conditions.failure);
+    }
+    ~AlarmJournal () {
+        _manager.unsubscribe (this);
+    }
+    AlarmJournal (const AlarmJournal &) = delete;
+    AlarmJournal &operator= (const AlarmJournal &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    // restores the journal kept in the store, which then receives it whenever it changes
+    bool begin (Store &store) {
+        _store = &store;
+        _key = storeKey (_config.prefix, _manager.getConfig ().id);
+        std::array<uint8_t, 2 + CAPACITY * RECORD> blob;
+        const size_t length = _store->load (_key, blob.data (), blob.size ());
+        if (length < 2 || blob [0] != VERSION || length != 2 + blob [1] * RECORD)
+            return false;
+        for (size_t i = 0; i < blob [1]; i++) {
+            const uint8_t *record = &blob [2 + i * RECORD];
+            append ({ static_cast<uint32_t> (record [0] | (record [1] << 8) | (record [2] << 16) | (static_cast<uint32_t> (record [3]) << 24)), record [4], static_cast<AlarmEvent::Kind> (record [5]) });
+            if (record [5] == static_cast<uint8_t> (AlarmEvent::Kind::Raised))
+                _reported |= bit (record [4]);
+            else
+                _reported &= ~bit (record [4]);
+        }
+        _dirty = false;
+        return true;
+    }
+    void process () {
+        if (_dirty && _store != nullptr && save ())
+            _dirty = false;
+    }
+
+    // the bits seen set and cleared, by code, without regard to debouncing
+    void update (const uint64_t word) {
+        const uint64_t rising = word & ~_reported, falling = _reported & ~word;
+        if (rising == 0 && falling == 0 && _pendingRaise == 0 && _pendingClear == 0)
+            return;
+        const SystemTicks_t ticks = systemTicksNow ();
+        forEachBit (_pendingRaise & ~word, [&] (const size_t code) {    // bounced before raised
+            _seen [code] = 0;
+        });
+        _pendingRaise &= word;
+        _pendingClear &= ~word;    // set again before cleared
+        forEachBit (rising, [&] (const size_t code) {
+            if (++_seen [code] >= _config.raise) {
+                _seen [code] = 0;
+                _pendingRaise &= ~bit (code);
+                _reported |= bit (code);
+                record (code, AlarmEvent::Kind::Raised);
+            } else
+                _pendingRaise |= bit (code);
+        });
+        forEachBit (falling, [&] (const size_t code) {
+            if (! (_pendingClear & bit (code))) {
+                _pendingClear |= bit (code);
+                _clearing [code] = ticks;
+            } else if (ticks - _clearing [code] >= _config.clear) {
+                _pendingClear &= ~bit (code);
+                _reported &= ~bit (code);
+                record (code, AlarmEvent::Kind::Cleared);
+            }
+        });
+    }
+
+    uint64_t active () const {    // raised and not yet cleared, by code
+        return _reported;
+    }
+    size_t size () const {
+        return _count;
+    }
+    // visits events oldest first, amongst the codes given as bits and within [from, to]
+    template <typename VISITOR>
+    void query (VISITOR &&visitor, const uint64_t codes = ALL, const uint32_t from = 0, const uint32_t to = UINT32_MAX) const {
+        for (size_t i = 0; i < _count; i++) {
+            const AlarmEvent &event = _events [(_head + CAPACITY - _count + i) % CAPACITY];
+            if ((codes & bit (event.code)) && event.time >= from && event.time <= to)
+                visitor (event);
+        }
+    }
+    void clear () {
+        _count = 0;
+        _dirty = true;
+    }
+
+private:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t RECORD = 6;
+    static uint32_t now () {
+        return static_cast<uint32_t> (::time (nullptr));
+    }
+    static constexpr uint64_t bit (const size_t code) {
+        return uint64_t { 1 } << code;
+    }
+    template <typename FUNCTION>
+    static void forEachBit (uint64_t bits, FUNCTION &&function) {
+        while (bits) {
+            function (static_cast<size_t> (__builtin_ctzll (bits)));
+            bits &= bits - 1;
+        }
+    }
+
+    bool handleFailure (RequestResponse &response) {
+        update (response.get (&RequestResponse_FAILURE::word));
+        return false;
+    }
+    void record (const size_t code, const AlarmEvent::Kind kind) {
+        const AlarmEvent event { _config.clock (), static_cast<uint8_t> (code), kind };
+        append (event);
+        _dirty = true;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: alarm %s: %s\n", _manager.getConfig ().id.c_str (), kind == AlarmEvent::Kind::Raised ? "raised" : "cleared", event.description ());
+        notifyHandlers (event);
+    }
+    void append (const AlarmEvent &event) {
+        _events [_head] = event;
+        _head = (_head + 1) % CAPACITY;
+        _count = std::min (_count + 1, CAPACITY);
+    }
+    bool save () {
+        std::array<uint8_t, 2 + CAPACITY * RECORD> blob;
+        blob [0] = VERSION;
+        blob [1] = static_cast<uint8_t> (_count);
+        size_t offset = 2;
+        query ([&] (const AlarmEvent &event) {
+            for (size_t b = 0; b < 4; b++)
+                blob [offset++] = static_cast<uint8_t> (event.time >> (8 * b));
+            blob [offset++] = event.code;
+            blob [offset++] = static_cast<uint8_t> (event.kind);
+        });
+        return _store->save (_key, blob.data (), offset);
+    }
+
+    MANAGER &_manager;
+    const Config _config;
+    Store *_store {};
+    String _key {};
+    std::array<AlarmEvent, CAPACITY> _events {};
+    size_t _head {}, _count {};
+    uint64_t _reported {}, _pendingRaise {}, _pendingClear {};
+    std::array<uint8_t, CODES> _seen {};
+    std::array<SystemTicks_t, CODES> _clearing {};
+    bool _dirty {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
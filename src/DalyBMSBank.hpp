@@ -0,0 +1,270 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct BankAggregates {
+    struct Extreme {
+        float voltage { NAN };
+        size_t pack {};
+        uint8_t cell {};    // from 1, as the BMS numbers them
+    };
+    size_t reporting {};        // packs with a fresh status
+    float current {};           // summed, amps
+    float charge { NAN };       // percent, weighted by rated capacity (by 1 while not known)
+    float voltage { NAN };      // mean of the packs
+    double capacity {};         // rated, summed, amps hours
+    Extreme cellMax {}, cellMin {};
+    uint64_t failures {};       // set in any pack, as bits by code
+    size_t failing {};          // packs with any failure set
+};
+
+// several packs in parallel, each a manager and optionally a balancer on the same cells, as one
+// bank: aggregates are maintained as each response arrives (the status of managers; extremes and
+// failures of both) by applying the change in that pack's contribution, so reading them costs
+// nothing. Only when the pack holding a bank-wide cell extreme moves away from it are the packs
+// rescanned. Failures are counted per code across packs. A member whose response is no longer
+// fresh has its contribution withdrawn by process (), so a silent pack drops out. Handlers are
+// passed the aggregates after each change
+
+template <typename MANAGER>
+class Bank : public Handlerable<const BankAggregates &> {
+public:
+    struct Pack {
+        MANAGER *manager;
+        MANAGER *balancer { nullptr };
+    };
+
+    explicit Bank (const std::vector<Pack> &packs) {
+        _members.reserve (packs.size () * 2);    // never reallocated, as members are subscription contexts
+        for (size_t pack = 0; pack < packs.size (); pack++) {
+            attach (pack, packs [pack].manager, true);
+            attach (pack, packs [pack].balancer, false);
+        }
+        _packs = packs.size ();
+    }
+    ~Bank () {
+        for (auto &member : _members)
+            member.device->unsubscribe (&member);
+    }
+    Bank (const Bank &) = delete;
+    Bank &operator= (const Bank &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    size_t size () const {
+        return _packs;
+    }
+    const BankAggregates &aggregates () const {
+        return _aggregates;
+    }
+    // withdraws what members contribute from responses no longer fresh, publishing if any was
+    void process () {
+        bool withdrawn = false;
+        for (auto &member : _members)
+            withdrawn = expire (member) || withdrawn;
+        if (withdrawn)
+            publish ();
+    }
+
+private:
+    struct Member {
+        Bank *bank;
+        MANAGER *device;
+        size_t pack;
+        bool manager;
+        bool reporting {};
+        float current {}, charge {}, voltage {};
+        double capacity {};
+        BankAggregates::Extreme max {}, min {};
+        uint64_t failures {};
+
+        bool handleStatus (RequestResponse &response) {
+            bank->status (*this, response);
+            return false;
+        }
+        bool handleRatings (RequestResponse &response) {
+            bank->ratings (*this, response);
+            return false;
+        }
+        bool handleExtremes (RequestResponse &response) {
+            bank->extremes (*this, response);
+            return false;
+        }
+        bool handleFailure (RequestResponse &response) {
+            bank->failure (*this, response);
+            return false;
+        }
+    };
+
+    void attach (const size_t pack, MANAGER *device, const bool manager) {
+        if (device == nullptr)
+            return;
+        Member &member = _members.emplace_back (Member { this, device, pack, manager });
+        if (manager) {
+            if constexpr (! is_request_response_disabled<decltype (device->conditions.status)>::value)
+                _subscribed = device->template subscribe<&Member::handleStatus> (&member, device->conditions.status) && _subscribed;
+            if constexpr (! is_request_response_disabled<decltype (device->information.battery_ratings)>::value)
+                _subscribed = device->template subscribe<&Member::handleRatings> (&member, device->information.battery_ratings) && _subscribed;
+        }
+        if constexpr (! is_request_response_disabled<decltype (device->conditions.voltage)>::value)
+            _subscribed = device->template subscribe<&Member::handleExtremes> (&member, device->conditions.voltage) && _subscribed;
+        if constexpr (! is_request_response_disabled<decltype (device->conditions.failure)>::value)
+            _subscribed = device->template subscribe<&Member::handleFailure> (&member, device->conditions.failure) && _subscribed;
+    }
+    static double weight (const double capacity) {
+        return capacity > 0.0 ? capacity : 1.0;
+    }
+
+    void status (Member &member, RequestResponse &response) {
+        const float current = response.get (&RequestResponse_STATUS::current), charge = response.get (&RequestResponse_STATUS::charge), voltage = response.get (&RequestResponse_STATUS::voltage);
+        withdraw (member);
+        member.reporting = true;
+        _aggregates.reporting++;
+        member.current = current, member.charge = charge, member.voltage = voltage;
+        _current += current;
+        _voltage += voltage;
+        _charge += weight (member.capacity) * charge;
+        _weights += weight (member.capacity);
+        publish ();
+    }
+    void withdraw (Member &member) {
+        if (! member.reporting)
+            return;
+        member.reporting = false;
+        if (--_aggregates.reporting == 0) {
+            _current = _voltage = _charge = _weights = 0.0;    // rather than the rounding left over
+            return;
+        }
+        _current -= member.current;
+        _voltage -= member.voltage;
+        _charge -= weight (member.capacity) * member.charge;
+        _weights -= weight (member.capacity);
+    }
+    void ratings (Member &member, RequestResponse &response) {
+        const double capacity = response.get (&RequestResponse_BATTERY_RATINGS::packCapacityAh);
+        if (capacity == member.capacity)
+            return;
+        if (member.reporting) {
+            _charge += (weight (capacity) - weight (member.capacity)) * member.charge;
+            _weights += weight (capacity) - weight (member.capacity);
+        }
+        _aggregates.capacity += capacity - member.capacity;
+        member.capacity = capacity;
+        publish ();
+    }
+    void extremes (Member &member, RequestResponse &response) {
+        const auto &value = response.get (&RequestResponse_VOLTAGE_MINMAX::value);
+        const auto &number = response.get (&RequestResponse_VOLTAGE_MINMAX::cellNumber);
+        const bool heldMax = held (_aggregates.cellMax, member.max, member.pack), heldMin = held (_aggregates.cellMin, member.min, member.pack);
+        member.max = { value.max, member.pack, number.max };
+        member.min = { value.min, member.pack, number.min };
+        auto &max = _aggregates.cellMax, &min = _aggregates.cellMin;
+        if (std::isnan (max.voltage) || member.max.voltage >= max.voltage)
+            max = member.max;
+        else if (heldMax)
+            rescan (true);
+        if (std::isnan (min.voltage) || member.min.voltage <= min.voltage)
+            min = member.min;
+        else if (heldMin)
+            rescan (false);
+        publish ();
+    }
+    static bool held (const BankAggregates::Extreme &bank, const BankAggregates::Extreme &member, const size_t pack) {
+        return ! std::isnan (member.voltage) && bank.pack == pack && bank.cell == member.cell && bank.voltage == member.voltage;
+    }
+    void rescan (const bool maximum) {
+        BankAggregates::Extreme &extreme = maximum ? _aggregates.cellMax : _aggregates.cellMin;
+        extreme = {};
+        for (const auto &member : _members) {
+            const BankAggregates::Extreme &candidate = maximum ? member.max : member.min;
+            if (! std::isnan (candidate.voltage) && (std::isnan (extreme.voltage) || (maximum ? candidate.voltage > extreme.voltage : candidate.voltage < extreme.voltage)))
+                extreme = candidate;
+        }
+    }
+    bool expire (Member &member) {
+        bool expired = false;
+        MANAGER &device = *member.device;
+        if constexpr (! is_request_response_disabled<decltype (device.conditions.status)>::value)
+            if (member.reporting && ! device.conditions.status.isFresh ()) {
+                withdraw (member);
+                expired = true;
+            }
+        if constexpr (! is_request_response_disabled<decltype (device.conditions.voltage)>::value)
+            if (! std::isnan (member.max.voltage) && ! device.conditions.voltage.isFresh ()) {
+                const bool heldMax = held (_aggregates.cellMax, member.max, member.pack), heldMin = held (_aggregates.cellMin, member.min, member.pack);
+                member.max = member.min = {};
+                if (heldMax)
+                    rescan (true);
+                if (heldMin)
+                    rescan (false);
+                expired = true;
+            }
+        if constexpr (! is_request_response_disabled<decltype (device.conditions.failure)>::value)
+            if (member.failures != 0 && ! device.conditions.failure.isFresh ())
+                expired = setFailures (member, 0) || expired;
+        return expired;
+    }
+    void failure (Member &member, RequestResponse &response) {
+        if (setFailures (member, response.get (&RequestResponse_FAILURE::word)))
+            publish ();
+    }
+    bool setFailures (Member &member, const uint64_t word) {
+        if (word == member.failures)
+            return false;
+        for (uint64_t changed = word ^ member.failures; changed != 0; changed &= changed - 1) {
+            const size_t code = static_cast<size_t> (__builtin_ctzll (changed));
+            const uint16_t count = (word >> code) & 1 ? ++_counts [code] : --_counts [code];
+            if (count > 0)
+                _aggregates.failures |= uint64_t { 1 } << code;
+            else
+                _aggregates.failures &= ~(uint64_t { 1 } << code);
+        }
+        const bool before = packFailing (member.pack);
+        member.failures = word;
+        const bool after = packFailing (member.pack);
+        if (after != before)
+            after ? _aggregates.failing++ : _aggregates.failing--;
+        return true;
+    }
+    bool packFailing (const size_t pack) const {    // the pack's manager and balancer
+        for (const auto &member : _members)
+            if (member.pack == pack && member.failures != 0)
+                return true;
+        return false;
+    }
+    void publish () {
+        _aggregates.current = static_cast<float> (_current);
+        _aggregates.voltage = _aggregates.reporting > 0 ? static_cast<float> (_voltage / _aggregates.reporting) : NAN;
+        _aggregates.charge = _weights > 0.0 ? static_cast<float> (_charge / _weights) : NAN;
+        notifyHandlers (_aggregates);
+    }
+
+    std::vector<Member> _members {};
+    size_t _packs {};
+    BankAggregates _aggregates {};
+    double _current {}, _voltage {}, _charge {}, _weights {};    // sums, so each update applies its difference
+    std::array<uint16_t, 64> _counts {};                          // packs' members per failure code
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
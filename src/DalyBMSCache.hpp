@@ -0,0 +1,262 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSStore.hpp"
+#endif
+
+#include <array>
+#include <vector>
+
+#ifndef DALYBMS_CACHE_SIZE
+#define DALYBMS_CACHE_SIZE 1024    // bytes of stored frames per interface at most
+#endif
+#ifndef DALYBMS_CACHE_ATTEMPTS
+#define DALYBMS_CACHE_ATTEMPTS 3    // revalidation requests per response before leaving it stale
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// keeps the raw frames of the responses needed once per session (Information, Thresholds) in a
+// Store, so that a restart restores them at once as valid but stale rather than requesting them
+// all before anything else. Stale responses are then re-requested one at a time while the manager
+// is otherwise idle; if the hardware/software identity re-requested first differs from the stored
+// one, everything still stale is invalidated. The store is rewritten only when content changed
+
+template <typename MANAGER>
+class Cache {
+public:
+    struct Config {
+        const char *prefix { "cache" };
+        Categories categories { Categories::Information + Categories::Thresholds };
+    };
+
+    Cache (MANAGER &manager, RequestResponseFrame::Receiver &connector, const Config &config = Config ()) :
+        _manager (manager),
+        _connector (connector),
+        _config (config) {
+        _manager.forEachComponent ([&] (const size_t index, const Categories category, auto &component) {
+            using Type = std::decay_t<decltype (component)>;
+            if ((category & _config.categories) != Categories::None)
+                _entries.push_back (Entry { &static_cast<RequestResponse &> (component), index, std::is_base_of_v<RequestResponse_BMS_HARDWARE, Type> || std::is_base_of_v<RequestResponse_BMS_SOFTWARE, Type> });
+        });
+        _subscribed = _connector.template registerHandler<&Cache::handleFrame> (this);
+    }
+    ~Cache () {
+        _connector.unregisterHandler (this);
+    }
+    Cache (const Cache &) = delete;
+    Cache &operator= (const Cache &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    // restores what the store holds for this interface, true if anything was; the store is kept for saving
+    bool begin (Store &store) {
+        _store = &store;
+        _key = storeKey (_config.prefix, _manager.getConfig ().id);
+        std::vector<uint8_t> blob (DALYBMS_CACHE_SIZE);
+        blob.resize (_store->load (_key, blob.data (), blob.size ()));
+        _restored = restore (blob);
+        if (_restored > 0) {
+            _saved = std::move (blob);
+            _identity = identity ();
+            for (const auto &entry : _entries)    // as if just received, now that all are in place
+                if (entry.stale)
+                    _manager.notify (*entry.response);
+        }
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: cache restored %u responses\n", _manager.getConfig ().id.c_str (), static_cast<unsigned> (_restored));
+        return _restored > 0;
+    }
+    // revalidates stale responses while the manager is idle, and saves at a quiet point after any changed
+    void process () {
+        if (_store == nullptr)
+            return;
+        if (_manager.isIdle ())
+            if (Entry *entry = nextStale ()) {
+                entry->attempts++;
+                _manager.issue (*entry->response);
+            }
+        if (_changed && _manager.isIdle () && nextStale () == nullptr)
+            save ();
+    }
+
+    bool isStale (const RequestResponse &response) const {
+        for (const auto &entry : _entries)
+            if (entry.response == &response)
+                return entry.stale;
+        return false;
+    }
+    size_t stale () const {
+        size_t count = 0;
+        for (const auto &entry : _entries)
+            count += entry.stale ? 1 : 0;
+        return count;
+    }
+    size_t restored () const {
+        return _restored;
+    }
+
+private:
+    using Data = std::array<uint8_t, RequestResponseFrame::Constants::SIZE_DATA>;
+    struct Entry {
+        RequestResponse *response;
+        size_t index;
+        bool identifying {};    // hardware or software, see identity ()
+        std::vector<Data> frames {};
+        size_t received {};
+        bool held {}, stale {};
+        size_t attempts {};
+    };
+    static constexpr uint8_t VERSION = 1;
+
+    bool isEnabled (const Entry &entry) const {
+        return (_manager.getEnabledComponents () >> entry.index) & 1;
+    }
+    Entry *find (const uint8_t command) {
+        for (auto &entry : _entries)
+            if (entry.response->getCommand () == command)
+                return &entry;
+        return nullptr;
+    }
+    Entry *nextStale () {    // identity first, as it decides whether the rest is worth keeping
+        Entry *next = nullptr;
+        for (auto &entry : _entries)
+            if (entry.stale && entry.attempts < DALYBMS_CACHE_ATTEMPTS && isEnabled (entry)) {
+                if (entry.identifying)
+                    return &entry;
+                if (next == nullptr)
+                    next = &entry;
+            }
+        return next;
+    }
+    uint32_t identity () {
+        uint32_t hash = 2166136261u;
+        for (const auto &entry : _entries)
+            if (entry.identifying && entry.held)
+                for (const auto &data : entry.frames)
+                    for (const auto byte : data)
+                        hash = (hash ^ byte) * 16777619u;
+        return hash;
+    }
+
+    bool handleFrame (RequestResponseFrame::Receiver::Handler::Type frame) {
+        if (frame.second != Direction::Receive)
+            return false;
+        Entry *entry = find (frame.first.getCommand ());
+        if (entry == nullptr)
+            return false;
+        const size_t expected = entry->response->getResponseFrameCount (), number = expected == 1 ? 1 : frame.first.getUInt8 (0);
+        if (number == 1)
+            entry->received = 0;
+        if (number != entry->received + 1 || number > expected)
+            return false;
+        entry->frames.resize (expected);
+        for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA; i++)
+            entry->frames [number - 1][i] = frame.first.getUInt8 (i);
+        if ((entry->received = number) == expected && entry->response->isValid ()) {    // decoded before us, by the manager
+            entry->held = true;
+            entry->stale = false;
+            entry->attempts = 0;
+            _changed = true;
+            if (entry->identifying)
+                checkIdentity ();
+        }
+        return false;
+    }
+    void checkIdentity () {
+        for (const auto &entry : _entries)
+            if (entry.identifying && isEnabled (entry) && (! entry.held || entry.stale))
+                return;
+        if (_restored == 0 || identity () == _identity)
+            return;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: cache identity changed, invalidating %u stale responses\n", _manager.getConfig ().id.c_str (), static_cast<unsigned> (stale ()));
+        for (auto &entry : _entries)
+            if (entry.stale) {
+                entry.response->invalidate ();
+                entry.held = false;
+            }
+        _identity = identity ();
+    }
+
+    // layout: version, count, then per response: command, frames, frames * data
+    size_t restore (const std::vector<uint8_t> &blob) {
+        size_t count = 0;
+        if (blob.size () < 2 || blob [0] != VERSION)
+            return 0;
+        size_t offset = 2;
+        for (size_t record = 0; record < blob [1] && offset + 2 <= blob.size (); record++) {
+            const uint8_t command = blob [offset], frames = blob [offset + 1];
+            offset += 2;
+            if (offset + frames * sizeof (Data) > blob.size ())
+                break;
+            Entry *entry = find (command);
+            if (entry != nullptr && isEnabled (*entry) && frames == entry->response->getResponseFrameCount ()) {
+                entry->frames.resize (frames);
+                entry->response->prepareRequest ();
+                for (size_t number = 0; number < frames; number++) {
+                    std::copy_n (&blob [offset + number * sizeof (Data)], sizeof (Data), entry->frames [number].begin ());
+                    entry->response->processResponse (build (command, entry->frames [number]));
+                }
+                if (entry->response->isValid ()) {
+                    entry->held = entry->stale = true;
+                    count++;
+                }
+            }
+            offset += frames * sizeof (Data);
+        }
+        return count;
+    }
+    static RequestResponseFrame build (const uint8_t command, const Data &data) {
+        RequestResponseFrame frame;
+        frame.setAddress (RequestResponseFrame::Constants::VALUE_ADDRESS_BMS_MASTER);
+        frame.setCommand (command);
+        for (size_t i = 0; i < data.size (); i++)
+            frame.setUInt8 (i, data [i]);
+        frame.finalize ();
+        return frame;
+    }
+    void save () {
+        std::vector<uint8_t> blob { VERSION, 0 };
+        for (const auto &entry : _entries)
+            if (entry.held && blob.size () + 2 + entry.frames.size () * sizeof (Data) <= DALYBMS_CACHE_SIZE) {
+                blob.push_back (entry.response->getCommand ());
+                blob.push_back (static_cast<uint8_t> (entry.frames.size ()));
+                for (const auto &data : entry.frames)
+                    blob.insert (blob.end (), data.begin (), data.end ());
+                blob [1]++;
+            }
+        _changed = false;
+        if (blob == _saved)
+            return;
+        if (_store->save (_key, blob.data (), blob.size ())) {
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: cache saved %u responses, %u bytes\n", _manager.getConfig ().id.c_str (), static_cast<unsigned> (blob [1]), static_cast<unsigned> (blob.size ()));
+            _saved = std::move (blob);
+        }
+    }
+
+    MANAGER &_manager;
+    RequestResponseFrame::Receiver &_connector;
+    const Config _config;
+    std::vector<Entry> _entries {};
+    Store *_store {};
+    String _key {};
+    std::vector<uint8_t> _saved {};
+    uint32_t _identity {};
+    size_t _restored {};
+    bool _changed {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
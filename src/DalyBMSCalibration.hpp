@@ -0,0 +1,145 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSStore.hpp"
+#endif
+
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// sweeps request pacing (gap between requests, pipelining depth) against the device behind a
+// manager, measuring loss and latency of a burst of condition requests at each setting, and
+// applies the fastest setting that lost nothing. Blocking: run at startup, not from the loop. The
+// setting is stored keyed by the interface, so later boots restore it rather than sweeping again
+
+template <typename MANAGER>
+class Calibration {
+public:
+    using Pacing = typename MANAGER::Pacing;
+
+    struct Config {
+        std::vector<SystemTicks_t> gaps { 80, 40, 20, 10, 5, 0 };
+        std::vector<size_t> depths { 1, 2, 4, 8 };
+        size_t rounds { 4 };                // bursts of all enabled condition requests per setting
+        SystemTicks_t timeout { 500 };      // per request while calibrating, so losses show quickly
+        SystemTicks_t settle { 1000 };      // before each setting, for stragglers of the previous
+        const char *prefix { "pace" };
+    };
+    struct Setting {
+        static constexpr uint32_t VERSION = 1;
+        uint32_t version { VERSION };
+        uint32_t gap {}, depth {};
+    };
+    struct Measurement {
+        Pacing pacing;
+        counter_t sent {}, completed {}, lost {};
+        SystemTicks_t latencyMean {}, elapsed {};
+        bool safe () const {
+            return sent > 0 && lost == 0 && completed == sent;
+        }
+        float rate () const {    // completed requests per second
+            return elapsed > 0 ? completed * 1000.0f / elapsed : 0.0f;
+        }
+    };
+
+    explicit Calibration (MANAGER &manager) :
+        _manager (manager) {
+    }
+
+    // restores the stored setting for this interface if any, otherwise calibrates and stores; true if
+    // either applied a setting
+    bool begin (Store &store, const Config &config = Config ()) {
+        const String key = storeKey (config.prefix, _manager.getConfig ().id);
+        Setting setting;
+        if (store.load (key, setting) && setting.version == Setting::VERSION) {
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: calibration restored gap=%lu depth=%lu\n", _manager.getConfig ().id.c_str (), static_cast<unsigned long> (setting.gap), static_cast<unsigned long> (setting.depth));
+            _restored = true;
+            _manager.setPacing ({ static_cast<SystemTicks_t> (setting.gap), static_cast<size_t> (setting.depth), _manager.getPacing ().timeout });
+            return true;
+        }
+        _restored = false;
+        Measurement chosen;
+        if (! calibrate (config, &chosen))
+            return false;
+        setting.gap = static_cast<uint32_t> (chosen.pacing.gap);
+        setting.depth = static_cast<uint32_t> (chosen.pacing.depth);
+        store.save (key, setting);
+        return true;
+    }
+    bool isRestored () const {
+        return _restored;
+    }
+
+    std::vector<Measurement> sweep (const Config &config) {
+        std::vector<Measurement> measurements;
+        const Pacing original = _manager.getPacing ();
+        for (const auto depth : config.depths)
+            for (const auto gap : config.gaps)
+                measurements.push_back (measure ({ gap, depth, config.timeout }, config));
+        _manager.setPacing (original);
+        return measurements;
+    }
+    // applies and returns the fastest safe setting, or leaves pacing unchanged if none was safe
+    bool calibrate (const Config &config, Measurement *chosen = nullptr) {
+        const auto measurements = sweep (config);
+        const Measurement *best = nullptr;
+        for (const auto &measurement : measurements)
+            if (measurement.safe () && (best == nullptr || measurement.rate () > best->rate ()))
+                best = &measurement;
+        if (best == nullptr)
+            return false;
+        _manager.setPacing ({ best->pacing.gap, best->pacing.depth, _manager.getPacing ().timeout });
+        if (chosen)
+            *chosen = *best;
+        return true;
+    }
+
+private:
+    Measurement measure (const Pacing &pacing, const Config &config) {
+        settle (config.settle);
+        _manager.setPacing (pacing);
+        const auto &status = _manager.getStatus ();
+        const counter_t sent = status.sent.count (), completed = status.completed.count (), timeouts = status.timeouts.count ();
+        const SystemTicks_t latencyTotal = status.latencyTotal, start = systemTicksNow ();
+        for (size_t round = 0; round < config.rounds; round++) {
+            _manager.request (Categories::Conditions);
+            while (! _manager.isIdle ()) {
+                _manager.process ();
+                delay (1);
+            }
+        }
+        Measurement measurement { pacing };
+        measurement.elapsed = systemTicksNow () - start;
+        measurement.sent = status.sent.count () - sent;
+        measurement.completed = status.completed.count () - completed;
+        measurement.lost = status.timeouts.count () - timeouts;
+        measurement.latencyMean = measurement.completed > 0 ? (status.latencyTotal - latencyTotal) / measurement.completed : 0;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: calibrate gap=%lu depth=%u: sent=%lu completed=%lu lost=%lu latency=%lu rate=%.1f/s\n", _manager.getConfig ().id.c_str (),
+                              static_cast<unsigned long> (pacing.gap), static_cast<unsigned> (pacing.depth), static_cast<unsigned long> (measurement.sent), static_cast<unsigned long> (measurement.completed), static_cast<unsigned long> (measurement.lost), static_cast<unsigned long> (measurement.latencyMean), measurement.rate ());
+        return measurement;
+    }
+    void settle (const SystemTicks_t duration) {    // drain whatever an earlier setting left on the line
+        const SystemTicks_t start = systemTicksNow ();
+        while (systemTicksNow () - start < duration) {
+            _manager.process ();
+            delay (1);
+        }
+    }
+
+    MANAGER &_manager;
+    bool _restored {};
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -0,0 +1,250 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSRequestResponse.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#if defined(__linux__)
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// Daly's CAN protocol carries the 0x90 to 0x98 commands with the same 8 data bytes as the UART
+// frame, in a 29-bit identifier 0x18 (priority), command, destination, source: the host is 0x40
+// and packs are from 0x01, so 0x18900140 asks pack 1 for its status and 0x18904001 answers. There
+// is no start byte, length or checksum, as CAN frames itself. Multi-frame responses (e.g. 0x95)
+// are several frames with the same identifier, numbered in the first data byte as on the UART
+
+struct CanProtocol {
+    static constexpr uint8_t PRIORITY = 0x18;
+    static constexpr uint8_t ADDRESS_HOST = 0x40;
+    static constexpr uint8_t ADDRESS_BMS = 0x01;
+
+    static constexpr canid_t identifier (const uint8_t command, const uint8_t destination, const uint8_t source) {
+        return CAN_EFF_FLAG | (static_cast<canid_t> (PRIORITY) << 24) | (static_cast<canid_t> (command) << 16) | (static_cast<canid_t> (destination) << 8) | source;
+    }
+    static constexpr bool carries (const uint8_t command) {    // the others are UART only
+        return command >= 0x90 && command <= 0x98;
+    }
+    static constexpr uint8_t command (const canid_t id) {
+        return static_cast<uint8_t> (id >> 16);
+    }
+    static constexpr uint8_t destination (const canid_t id) {
+        return static_cast<uint8_t> (id >> 8);
+    }
+    static constexpr uint8_t source (const canid_t id) {
+        return static_cast<uint8_t> (id);
+    }
+
+    static struct can_frame toCan (const uint8_t command, const uint8_t destination, const uint8_t source, const uint8_t *data) {
+        struct can_frame frame {};
+        frame.can_id = identifier (command, destination, source);
+        frame.can_dlc = RequestResponseFrame::Constants::SIZE_DATA;
+        std::memcpy (frame.data, data, RequestResponseFrame::Constants::SIZE_DATA);
+        return frame;
+    }
+    // the frame as the UART would have carried it, so that it passes through the same assembly,
+    // validation and decoding; false for anything not an extended data frame of 8 bytes
+    static bool fromCan (const struct can_frame &frame, RequestResponseFrame &result) {
+        if ((frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) != CAN_EFF_FLAG || frame.can_dlc != RequestResponseFrame::Constants::SIZE_DATA)
+            return false;
+        result.setAddress (RequestResponseFrame::Constants::VALUE_ADDRESS_BMS_MASTER);
+        result.setCommand (command (frame.can_id));
+        for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA; i++)
+            result.setUInt8 (i, frame.data [i]);
+        result.finalize ();
+        return true;
+    }
+
+    // extended data frames from source to destination, of any command: the command byte is masked
+    // out, and the flags are compared so that remote and standard frames never match
+    static constexpr struct can_filter filter (const uint8_t source, const uint8_t destination) {
+        return { .can_id = identifier (0, destination, source), .can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | 0xFF00FFFFu };
+    }
+    static constexpr bool matches (const struct can_filter &filter, const canid_t id) {    // as the kernel applies it
+        return (id & filter.can_mask) == (filter.can_id & filter.can_mask);
+    }
+
+    // a raw, non-blocking socket bound to the interface, receiving only frames from source to
+    // destination (of any command), as filtered in the kernel
+    static int open (const String &interface, const uint8_t source, const uint8_t destination) {
+        const int fd = ::socket (PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+        if (fd < 0)
+            return -1;
+        const struct can_filter filter = CanProtocol::filter (source, destination);
+        struct sockaddr_can address {};
+        address.can_family = AF_CAN;
+        address.can_ifindex = static_cast<int> (::if_nametoindex (interface.c_str ()));
+        if (address.can_ifindex == 0 || ::setsockopt (fd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof (filter)) < 0 || ::bind (fd, reinterpret_cast<struct sockaddr *> (&address), sizeof (address)) < 0) {
+            const int error = errno;
+            ::close (fd);
+            errno = error ? error : ENODEV;
+            return -1;
+        }
+        return fd;
+    }
+    // waits for transmit space (ENOBUFS when the interface queue is full) up to timeoutMs
+    static bool send (const int fd, const struct can_frame &frame, const int timeoutMs) {
+        for (;;) {
+            const ssize_t written = ::write (fd, &frame, sizeof (frame));
+            if (written == static_cast<ssize_t> (sizeof (frame)))
+                return true;
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+                struct pollfd writable = { .fd = fd, .events = POLLOUT, .revents = 0 };
+                if (::poll (&writable, 1, timeoutMs) <= 0)
+                    return false;
+                continue;
+            }
+            return false;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------------------------
+
+// connector for a pack on a SocketCAN interface (e.g. can0 at 250 or 500 kbit/s, or vcan0 for
+// testing): requests are written as one CAN frame each, and each CAN frame received from the pack
+// is handed on as the equivalent UART frame, so managers and decoders are unchanged. A frame takes
+// ~0.5ms on the bus at 250 kbit/s against ~13.5ms on the UART at 9600 baud. Frames the pack
+// broadcasts without being asked arrive the same way and update the responses as any other.
+// Several packs share an interface with one connector each, told apart by their address. Only
+// 0x90 to 0x98 are carried, so a manager on this connector never configures the others (the
+// Information, Thresholds and Commands requests), whatever its capabilities
+
+class CanConnector : public RequestResponseFrame::Receiver {
+public:
+    struct Config {
+        String interface { "can0" };
+        uint8_t address { CanProtocol::ADDRESS_BMS };
+        int writeTimeoutMs { 100 };
+    };
+    struct Statistics {
+        counter_t transmitted {}, received {}, rejected {};    // rejected: not a data frame of 8 bytes
+    };
+
+    explicit CanConnector (const Config &config) :
+        _config (config) {
+    }
+    ~CanConnector () {
+        end ();
+    }
+    CanConnector (const CanConnector &) = delete;
+    CanConnector &operator= (const CanConnector &) = delete;
+
+    bool isOpen () const {
+        return _fd >= 0;
+    }
+    bool carries (const uint8_t command) const override {
+        return CanProtocol::carries (command);
+    }
+    int fd () const {    // for callers that run their own poll/epoll loop, e.g. PosixReactor
+        return _fd;
+    }
+    // waits up to timeoutMs (-1 forever) for a frame and reads what has arrived, true if any did;
+    // when deferred this is the reading side, leaving dispatch to process ()
+    bool await (const int timeoutMs) {
+        if (! isOpen ())
+            return false;
+        struct pollfd readable = { .fd = _fd, .events = POLLIN, .revents = 0 };
+        int result;
+        while ((result = ::poll (&readable, 1, timeoutMs)) < 0 && errno == EINTR)
+            ;
+        if (result <= 0)
+            return false;
+        drain ();
+        return true;
+    }
+    const Statistics &getStatistics () const {
+        return _statistics;
+    }
+
+    void begin () override {
+        if (isOpen ())
+            return;
+        if ((_fd = CanProtocol::open (_config.interface, _config.address, CanProtocol::ADDRESS_HOST)) < 0)
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: open failed: %s\n", _config.interface.c_str (), ::strerror (errno));
+        _chunkOffset = _chunkSize = 0;
+    }
+    void end () override {
+        if (_fd >= 0)
+            ::close (_fd);
+        _fd = -1;
+    }
+
+protected:
+    bool readByte (uint8_t *byte) override {
+        if (_chunkOffset == _chunkSize && ! readFrame ())
+            return false;
+        *byte = _chunk [_chunkOffset++];
+        return true;
+    }
+    bool writeBytes (const uint8_t *data, const size_t size) override {
+        if (! isOpen () || size != RequestResponseFrame::size ())
+            return false;
+        if (! CanProtocol::send (_fd, CanProtocol::toCan (data [RequestResponseFrame::Constants::OFFSET_COMMAND], _config.address, CanProtocol::ADDRESS_HOST, data + RequestResponseFrame::Constants::SIZE_HEADER), _config.writeTimeoutMs)) {
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: write failed: %s\n", _config.interface.c_str (), ::strerror (errno));
+            return false;
+        }
+        _statistics.transmitted++;
+        return true;
+    }
+
+private:
+    bool readFrame () {
+        if (! isOpen ())
+            return false;
+        struct can_frame frame;
+        ssize_t result;
+        for (;;) {
+            while ((result = ::read (_fd, &frame, sizeof (frame))) < 0 && errno == EINTR)
+                ;
+            if (result < static_cast<ssize_t> (sizeof (frame))) {
+                if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: read failed: %s\n", _config.interface.c_str (), ::strerror (errno));
+                return false;
+            }
+            RequestResponseFrame translated;
+            if (CanProtocol::fromCan (frame, translated)) {
+                std::memcpy (_chunk.data (), translated.data (), RequestResponseFrame::size ());
+                _chunkOffset = 0;
+                _chunkSize = RequestResponseFrame::size ();
+                _statistics.received++;
+                return true;
+            }
+            _statistics.rejected++;
+        }
+    }
+
+    const Config _config;
+    int _fd { -1 };
+    std::array<uint8_t, RequestResponseFrame::Constants::SIZE_FRAME> _chunk {};
+    size_t _chunkOffset {}, _chunkSize {};
+    Statistics _statistics {};
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
+
+#endif    // __linux__
@@ -0,0 +1,450 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSRequestResponse.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// native serial connector for Linux hosts (e.g. USB-UART adapters): a raw termios fd in
+// non-blocking mode, read in chunks, and an epoll instance so callers can sleep until bytes
+// arrive rather than polling process ()
+
+class PosixConnector : public RequestResponseFrame::Receiver {
+public:
+    struct Config {
+        String device;
+        int baud { 9600 };
+        int writeTimeoutMs { 100 };
+    };
+
+    explicit PosixConnector (const Config &config) :
+        _config (config) {
+    }
+    ~PosixConnector () {
+        end ();
+    }
+    PosixConnector (const PosixConnector &) = delete;
+    PosixConnector &operator= (const PosixConnector &) = delete;
+
+    bool isOpen () const {    // false once a read finds the device gone, until begin () reopens it
+        return _fd >= 0;
+    }
+    int fd () const {    // for callers that run their own poll/epoll loop
+        return _fd;
+    }
+    // waits up to timeoutMs (-1 forever) for readable bytes and reads them, true if any arrived;
+    // when deferred this is the reading side, leaving dispatch to process (). A hang up or error
+    // wakes it as readable, and the read that follows closes the port
+    bool await (const int timeoutMs) {
+        if (_epoll < 0)
+            return false;
+        struct epoll_event event;
+        int result;
+        while ((result = ::epoll_wait (_epoll, &event, 1, timeoutMs)) < 0 && errno == EINTR)
+            ;
+        if (result <= 0)
+            return false;
+        drain ();
+        return true;
+    }
+
+    void begin () override {
+        if (isOpen ())
+            return;
+        if ((_fd = ::open (_config.device.c_str (), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)) < 0)
+            return failed ("open");
+        if (! configure ())
+            return failed ("configure");
+        if ((_epoll = ::epoll_create1 (EPOLL_CLOEXEC)) < 0)
+            return failed ("epoll_create1");
+        struct epoll_event event = { .events = EPOLLIN, .data = { .fd = _fd } };
+        if (::epoll_ctl (_epoll, EPOLL_CTL_ADD, _fd, &event) < 0)
+            return failed ("epoll_ctl");
+        _chunkOffset = _chunkSize = 0;
+    }
+    void end () override {
+        if (_epoll >= 0)
+            ::close (_epoll);
+        if (_fd >= 0)
+            ::close (_fd);
+        _epoll = _fd = -1;
+    }
+
+protected:
+    bool readByte (uint8_t *byte) override {
+        if (_chunkOffset == _chunkSize && ! readChunk ())
+            return false;
+        *byte = _chunk [_chunkOffset++];
+        return true;
+    }
+    bool writeBytes (const uint8_t *data, const size_t size) override {
+        if (! isOpen ())
+            return false;
+        size_t offset = 0;
+        while (offset < size) {
+            const ssize_t written = ::write (_fd, data + offset, size - offset);
+            if (written > 0)
+                offset += static_cast<size_t> (written);
+            else if (written < 0 && errno == EINTR)
+                continue;
+            else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                struct pollfd writable = { .fd = _fd, .events = POLLOUT, .revents = 0 };
+                if (::poll (&writable, 1, _config.writeTimeoutMs) <= 0) {
+                    DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: write timeout (%zu of %zu)\n", _config.device.c_str (), offset, size);
+                    return false;
+                }
+            } else {
+                ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: write failed: %s\n", _config.device.c_str (), ::strerror (errno));
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool readChunk () {
+        if (! isOpen ())
+            return false;
+        ssize_t result;
+        while ((result = ::read (_fd, _chunk.data (), _chunk.size ())) < 0 && errno == EINTR)
+            ;
+        if ((result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) || (result == 0 && ! isHungUp ()))    // as VMIN 0 reads nothing as 0
+            return false;
+        if (result <= 0) {    // hung up, or an error such as EIO once unplugged, is final: closed rather than read again
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: read failed, closing: %s\n", _config.device.c_str (), result == 0 ? "hung up" : ::strerror (errno));
+            end ();
+            return false;
+        }
+        _chunkOffset = 0;
+        _chunkSize = static_cast<size_t> (result);
+        return true;
+    }
+    bool isHungUp () const {
+        struct pollfd hungup = { .fd = _fd, .events = 0, .revents = 0 };
+        return ::poll (&hungup, 1, 0) > 0 && (hungup.revents & (POLLHUP | POLLERR));
+    }
+    bool configure () {
+        struct termios tty;
+        if (::tcgetattr (_fd, &tty) < 0)
+            return false;
+        ::cfmakeraw (&tty);
+        tty.c_cflag |= CLOCAL | CREAD;
+        tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+        tty.c_cc [VMIN] = 0;
+        tty.c_cc [VTIME] = 0;
+        const speed_t speed = toSpeed (_config.baud);
+        if (::cfsetispeed (&tty, speed) < 0 || ::cfsetospeed (&tty, speed) < 0)
+            return false;
+        if (::tcsetattr (_fd, TCSANOW, &tty) < 0)
+            return false;
+        ::tcflush (_fd, TCIOFLUSH);
+        return true;
+    }
+    void failed (const char *operation) {
+        ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: %s failed: %s\n", _config.device.c_str (), operation, ::strerror (errno));
+        end ();
+    }
+    static speed_t toSpeed (const int baud) {
+        switch (baud) {
+        case 1200 : return B1200;
+        case 2400 : return B2400;
+        case 4800 : return B4800;
+        case 19200 : return B19200;
+        case 38400 : return B38400;
+        case 57600 : return B57600;
+        case 115200 : return B115200;
+        default : return B9600;
+        }
+    }
+
+    const Config _config;
+    int _fd { -1 }, _epoll { -1 };
+    std::array<uint8_t, 256> _chunk {};
+    size_t _chunkOffset {}, _chunkSize {};
+};
+
+// -----------------------------------------------------------------------------------------------
+
+// single-threaded reactor for gateways with many ports: every fd sits in one epoll set so only
+// ready ports are dispatched, and all timeouts and scheduled polls share one timer heap that also
+// bounds the epoll wait. A port that hangs up or errors is dispatched once more, to read what
+// remains, then removed
+
+class PosixReactor {
+public:
+    // non-owning, heap-free binding of a member function known at compile time
+    class Action {
+    public:
+        Action () = default;
+        template <auto METHOD, typename CONTEXT>
+        static Action bind (CONTEXT *context) {
+            Action action;
+            action._context = context;
+            action._function = &invokeMethod<METHOD, CONTEXT>;
+            return action;
+        }
+        inline void operator() () const {
+            _function (_context);
+        }
+        bool isBoundTo (const void *context) const {
+            return _context == context;
+        }
+
+    private:
+        template <auto METHOD, typename CONTEXT>
+        static void invokeMethod (void *context) {
+            (static_cast<CONTEXT *> (context)->*METHOD) ();
+        }
+        void *_context {};
+        void (*_function) (void *) {};
+    };
+    using TimerId = size_t;
+    using Ticks = int64_t;    // microseconds, monotonic
+
+    struct Statistics {
+        uint32_t wakes {}, dispatches {}, timers {}, hangups {};
+        Ticks jitterTotal {}, jitterMax {};    // lateness of timers against their deadlines
+        Ticks jitterMean () const {
+            return timers ? jitterTotal / timers : 0;
+        }
+    };
+
+    PosixReactor () :
+        _epoll (::epoll_create1 (EPOLL_CLOEXEC)) {
+        if (_epoll < 0)
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<reactor>: epoll_create1 failed: %s\n", ::strerror (errno));
+    }
+    ~PosixReactor () {
+        if (_epoll >= 0)
+            ::close (_epoll);
+    }
+    PosixReactor (const PosixReactor &) = delete;
+    PosixReactor &operator= (const PosixReactor &) = delete;
+
+    static Ticks now () {
+        struct timespec ts;
+        ::clock_gettime (CLOCK_MONOTONIC, &ts);
+        return static_cast<Ticks> (ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    bool add (const int fd, const Action &ready) {
+        if (_epoll < 0 || fd < 0)
+            return false;
+        size_t slot = std::find_if (_ports.begin (), _ports.end (), [] (const Port &port) { return port.fd < 0; }) - _ports.begin ();
+        if (slot == _ports.size ())
+            _ports.push_back ({});
+        struct epoll_event event = { .events = EPOLLIN, .data = { .u64 = slot } };
+        if (::epoll_ctl (_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+            return false;
+        _ports [slot] = { fd, ready };
+        return true;
+    }
+    bool add (PosixConnector &connector) {
+        return add (connector.fd (), Action::bind<&PosixConnector::process> (&connector));
+    }
+    // as above, but drives the manager: its process () runs when the port is ready and again by a
+    // timer at whatever it next has due (see untilDue ()), re-armed after each of its own dispatches,
+    // so requests are paced, time out and refresh without the caller polling
+    template <typename MANAGER>
+    bool add (PosixConnector &connector, MANAGER &manager) {
+        auto driven = std::make_unique<Driven> (Driven { this, connector.fd (), &manager, &invokeProcess<MANAGER>, &invokeUntilDue<MANAGER> });
+        if (! add (connector.fd (), Action::bind<&Driven::process> (driven.get ())))
+            return false;
+        _driven.push_back (std::move (driven));
+        rearm (*_driven.back ());
+        return true;
+    }
+    void remove (const int fd) {
+        for (auto &port : _ports)
+            if (port.fd == fd) {
+                ::epoll_ctl (_epoll, EPOLL_CTL_DEL, fd, nullptr);
+                port.fd = -1;
+            }
+        for (auto it = _driven.begin (); it != _driven.end ();)
+            if ((*it)->fd == fd) {
+                const Driven *driven = it->get ();    // including timers superseded but not yet reached
+                _timers.erase (std::remove_if (_timers.begin (), _timers.end (), [driven] (const Timer &timer) { return timer.action.isBoundTo (driven); }), _timers.end ());
+                std::make_heap (_timers.begin (), _timers.end (), Timer::later);
+                it = _driven.erase (it);
+            } else
+                ++it;
+    }
+
+    // one-shot after delayMs, or then periodic every periodMs measured from the deadline not the
+    // firing, so that lateness does not accumulate
+    TimerId schedule (const uint32_t delayMs, const Action &action, const uint32_t periodMs = 0) {
+        const TimerId id = _timerNext++;
+        _timers.push_back ({ now () + static_cast<Ticks> (delayMs) * 1000, static_cast<Ticks> (periodMs) * 1000, id, action });
+        std::push_heap (_timers.begin (), _timers.end (), Timer::later);
+        return id;
+    }
+    // as above, calling METHOD on a manager this reactor drives, re-armed after as anything it
+    // issues changes what it next has due
+    template <auto METHOD, typename MANAGER>
+    TimerId schedule (const uint32_t delayMs, MANAGER &manager, const uint32_t periodMs = 0) {
+        for (auto &driven : _driven)
+            if (driven->manager == &manager)
+                return schedule (delayMs, Action::bind<&Driven::template invoke<METHOD, MANAGER>> (driven.get ()), periodMs);
+        return schedule (delayMs, Action::bind<METHOD> (&manager), periodMs);
+    }
+    void cancel (const TimerId id) {    // linear in the timers: for the occasional caller, not per dispatch
+        const auto it = std::find_if (_timers.begin (), _timers.end (), [id] (const Timer &timer) { return timer.id == id; });
+        if (it != _timers.end ()) {
+            _timers.erase (it);
+            std::make_heap (_timers.begin (), _timers.end (), Timer::later);
+        }
+    }
+
+    // waits for the earlier of a ready port, the next timer, or maxWaitMs (-1 unbounded), then
+    // dispatches; returns the number of ports and timers dispatched
+    size_t runOnce (const int maxWaitMs = -1) {
+        int timeout = maxWaitMs;
+        if (! _timers.empty ()) {
+            const Ticks until = std::max<Ticks> (0, (_timers.front ().deadline - now () + 999) / 1000);
+            if (timeout < 0 || until < timeout)
+                timeout = static_cast<int> (until);
+        }
+        int ready;
+        while ((ready = ::epoll_wait (_epoll, _events.data (), static_cast<int> (_events.size ()), timeout)) < 0 && errno == EINTR)
+            ;
+        _statistics.wakes++;
+        size_t dispatched = 0;
+        for (int i = 0; i < ready; i++) {
+            const Port port = _ports [_events [i].data.u64];    // copied, as the action may add or remove ports
+            if (port.fd >= 0) {
+                port.ready ();
+                dispatched++;
+                if (_events [i].events & (EPOLLHUP | EPOLLERR)) {    // reported until removed, so would wake every wait
+                    ALWAYS_DEBUG_PRINTF ("DalyBMS<reactor>: fd %d hung up, removed\n", port.fd);
+                    remove (port.fd);
+                    _statistics.hangups++;
+                }
+            }
+        }
+        _statistics.dispatches += dispatched;
+        for (Ticks time = now (); ! _timers.empty () && _timers.front ().deadline <= time; time = now ()) {
+            std::pop_heap (_timers.begin (), _timers.end (), Timer::later);
+            Timer timer = _timers.back ();
+            _timers.pop_back ();
+            const Ticks lateness = time - timer.deadline;
+            _statistics.timers++;
+            _statistics.jitterTotal += lateness;
+            _statistics.jitterMax = std::max (_statistics.jitterMax, lateness);
+            if (timer.period > 0) {
+                timer.deadline += timer.period;
+                _timers.push_back (timer);
+                std::push_heap (_timers.begin (), _timers.end (), Timer::later);
+            }
+            _firing = timer.id;
+            timer.action ();
+            dispatched++;
+        }
+        return dispatched;
+    }
+    const Statistics &getStatistics () const {
+        return _statistics;
+    }
+    void resetStatistics () {
+        _statistics = Statistics {};
+    }
+
+private:
+    struct Port {
+        int fd { -1 };
+        Action ready;
+    };
+    struct Timer {
+        Ticks deadline, period;
+        TimerId id;
+        Action action;
+        static bool later (const Timer &a, const Timer &b) {
+            return a.deadline > b.deadline;
+        }
+    };
+    struct Driven {
+        PosixReactor *reactor;
+        int fd;
+        void *manager;
+        void (*run) (void *);
+        Ticks (*until) (const void *);    // ms, or -1 if nothing is due
+        TimerId timer {};
+        Ticks deadline {};
+        bool armed {};
+        void process () {
+            run (manager);
+            reactor->rearm (*this);
+        }
+        void expire () {
+            if (! armed || reactor->_firing != timer)    // superseded by an earlier one, see rearm ()
+                return;
+            armed = false;
+            process ();
+        }
+        template <auto METHOD, typename MANAGER>
+        void invoke () {
+            (static_cast<MANAGER *> (manager)->*METHOD) ();
+            reactor->rearm (*this);
+        }
+    };
+    template <typename MANAGER>
+    static void invokeProcess (void *manager) {
+        static_cast<MANAGER *> (manager)->process ();
+    }
+    template <typename MANAGER>
+    static Ticks invokeUntilDue (const void *manager) {
+        const SystemTicks_t until = static_cast<const MANAGER *> (manager)->untilDue ();
+        return until == MANAGER::DUE_NEVER ? -1 : static_cast<Ticks> (until);
+    }
+    // one live timer per driven manager at its next due time: kept if no later than needed, as
+    // waking early costs only a process (), otherwise superseded by a new one; the old one is left
+    // in the heap rather than searched for, and does nothing when reached
+    void rearm (Driven &driven) {
+        const Ticks until = driven.until (driven.manager);
+        if (until < 0)
+            return;
+        const Ticks deadline = now () + until * 1000;
+        if (driven.armed && driven.deadline <= deadline)
+            return;
+        driven.timer = schedule (static_cast<uint32_t> (until), Action::bind<&Driven::expire> (&driven));
+        driven.deadline = deadline;
+        driven.armed = true;
+    }
+
+    const int _epoll;
+    std::vector<Port> _ports {};
+    std::vector<Timer> _timers {};
+    TimerId _timerNext {}, _firing {};
+    std::vector<std::unique_ptr<Driven>> _driven {};    // stable, as their addresses are bound into actions
+    std::array<struct epoll_event, 64> _events {};
+    Statistics _statistics {};
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
+
+#endif    // __linux__
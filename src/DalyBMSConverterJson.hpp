@@ -211,7 +211,7 @@ void addToJson (const TYPE flags, JsonArray &&arr) {
         if ((flags & flag) != TYPE::None)
             arr.add (toString (flag));
 }
-STATIC_IF_ARDUINO_IDE bool convertToJson (const Manager::Config &src, JsonVariant dst) {
+STATIC_IF_ARDUINO_IDE bool convertToJson (const ManagerConfig &src, JsonVariant dst) {
     dst ["id"] = src.id;
     addToJson (src.capabilities, dst ["capabilities"].to<JsonArray> ());
     addToJson (src.categories, dst ["categories"].to<JsonArray> ());
@@ -222,58 +222,34 @@ STATIC_IF_ARDUINO_IDE bool convertToJson (const Manager::Config &src, JsonVarian
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
 
-STATIC_IF_ARDUINO_IDE bool convertToJson (const Manager &src, JsonVariant dst) {
+template <Capabilities CAPABILITIES, Categories CATEGORIES>
+STATIC_IF_ARDUINO_IDE bool convertToJson (const BasicManager<CAPABILITIES, CATEGORIES> &src, JsonVariant dst) {
 
-    const auto convertConfig = [&] (const Manager::Config &config) {
+    const auto convertConfig = [&] (const ManagerConfig &config) {
         dst ["config"] = config;
     };
-    const auto convertCategory = [&] (const Manager::Config &config, const Categories category) -> JsonVariant {
+    const auto convertCategory = [&] (const ManagerConfig &config, const Categories category) -> JsonVariant {
         return dst [toString (category)];
     };
+    JsonVariant ages = dst ["age"];    // seconds since receipt, by name; those past their time to live also listed as stale
+    JsonArray stale = dst ["stale"].to<JsonArray> ();
     const auto convertElement = [&] (auto &&handler, const auto &component) {
-        if (src.isEnabled (&component) && component.isValid ())
+        if (component.decode ()) {
             handler [getName (component)] = component;
+            ages [getName (component)] = systemSecsSince (component.valid ());
+            if (! component.isFresh ())
+                stale.add (getName (component));
+        }
     };
 
     convertConfig (src.getConfig ());
-    if (src.isEnabled (Categories::Information)) {
-        auto information = convertCategory (src.getConfig (), Categories::Information);
-        convertElement (information, src.information.config);
-        convertElement (information, src.information.hardware);
-        convertElement (information, src.information.firmware);
-        convertElement (information, src.information.software);
-        convertElement (information, src.information.battery_ratings);
-        convertElement (information, src.information.battery_code);
-        convertElement (information, src.information.battery_info);
-        convertElement (information, src.information.battery_stat);
-        convertElement (information, src.information.rtc);
-    }
-    if (src.isEnabled (Categories::Thresholds)) {
-        auto thresholds = convertCategory (src.getConfig (), Categories::Thresholds);
-        convertElement (thresholds, src.thresholds.voltage);
-        convertElement (thresholds, src.thresholds.current);
-        convertElement (thresholds, src.thresholds.sensor);
-        convertElement (thresholds, src.thresholds.charge);
-        convertElement (thresholds, src.thresholds.cell_voltage);
-        convertElement (thresholds, src.thresholds.cell_sensor);
-        convertElement (thresholds, src.thresholds.cell_balance);
-        convertElement (thresholds, src.thresholds.shortcircuit);
-    }
-    if (src.isEnabled (Categories::Conditions)) {
-        auto conditions = convertCategory (src.getConfig (), Categories::Conditions);
-        convertElement (conditions, src.conditions.status);
-        convertElement (conditions, src.conditions.voltage);
-        convertElement (conditions, src.conditions.sensor);
-        convertElement (conditions, src.conditions.mosfet);
-        convertElement (conditions, src.conditions.information);
-        convertElement (conditions, src.conditions.failure);
-    }
-    if (src.isEnabled (Categories::Diagnostics)) {
-        auto diagnostics = convertCategory (src.getConfig (), Categories::Diagnostics);
-        convertElement (diagnostics, src.diagnostics.voltages);
-        convertElement (diagnostics, src.diagnostics.sensors);
-        convertElement (diagnostics, src.diagnostics.balances);
-    }
+    Categories current = Categories::None;
+    JsonVariant group;
+    src.forEachEnabledComponent (Categories::Information + Categories::Thresholds + Categories::Conditions + Categories::Diagnostics, [&] (const Categories category, const auto &component) {
+        if (category != current)
+            group = convertCategory (src.getConfig (), current = category);
+        convertElement (group, component);
+    });
     return true;
 }
 
@@ -0,0 +1,204 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSStore.hpp"
+#endif
+
+#include <array>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// finds which requests a device actually answers, rather than relying on hand-configured
+// Capabilities: probes every compiled-in request except commands, counts the valid frames that come
+// back, and narrows the manager to the responders (configure Capabilities::All to let it decide).
+// The result is stored keyed by the hardware/software identity, so later boots only ask for that
+// identity and restore the rest without probing; the frames the identity strings take are stored
+// keyed by the interface, as a device answering with other than the usual cannot be identified
+// without them
+
+template <typename MANAGER>
+class Discovery {
+public:
+    struct Config {
+        SystemTicks_t timeout { 1000 };    // per request while probing
+        const char *prefix { "caps" };
+        const char *prefixIdentity { "ident" };
+    };
+    struct Profile {
+        static constexpr uint32_t VERSION = 1;
+        uint32_t version { VERSION };
+        uint32_t responding {};                // by registry index
+        std::array<uint8_t, 32> frames {};    // answered per request, by registry index
+    };
+    struct Identity {
+        static constexpr uint32_t VERSION = 1;
+        uint32_t version { VERSION };
+        uint8_t hardware {}, software {};    // frames of each string
+    };
+
+    Discovery (MANAGER &manager, RequestResponseFrame::Receiver &connector) :
+        _manager (manager),
+        _connector (connector) {
+        _subscribed = _connector.template registerHandler<&Discovery::handleFrame> (this);
+    }
+    ~Discovery () {
+        _connector.unregisterHandler (this);
+    }
+    Discovery (const Discovery &) = delete;
+    Discovery &operator= (const Discovery &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    // restores the stored profile for this device if any, otherwise probes and stores; applies either
+    bool begin (Store &store, const Config &config = Config ()) {
+        const String keyIdentity = storeKey (config.prefixIdentity, _manager.getConfig ().id);
+        Identity lengths;
+        if (store.load (keyIdentity, lengths) && lengths.version == Identity::VERSION)
+            applyIdentity (lengths);
+        String identity = identify (config);
+        if (! identity.isEmpty () && store.load (storeKey (config.prefix, identity), _profile) && _profile.version == Profile::VERSION) {
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: discovery restored for '%s'\n", _manager.getConfig ().id.c_str (), identity.c_str ());
+            _restored = true;
+            apply (_profile);
+            return true;
+        }
+        if (! probe (config))
+            return false;
+        if (identity.isEmpty ())
+            identity = identified ();    // probing found the frames the strings take, if not as expected
+        if (! identity.isEmpty ()) {
+            store.save (storeKey (config.prefix, identity), _profile);
+            store.save (keyIdentity, identityLengths ());
+        }
+        return true;
+    }
+    bool probe (const Config &config = Config ()) {
+        _counts.fill (0);
+        _profile = Profile ();
+        _restored = false;
+        const auto pacing = _manager.getPacing ();
+        _manager.setPacing ({ pacing.gap, pacing.depth, config.timeout });
+        issue (Categories::Information + Categories::Thresholds + Categories::Conditions);
+        issue (Categories::Diagnostics);    // sized by the information just received
+        _manager.forEachComponent ([&] (const size_t, const Categories, auto &component) {
+            if constexpr (requires { component.setLength (size_t {}); })
+                if (_counts [component.getCommand ()] > 0 && _counts [component.getCommand ()] != component.getResponseFrameCount () && component.setLength (_counts [component.getCommand ()])) {
+                    _counts [component.getCommand ()] = 0;
+                    _manager.issue (component);
+                    settle ();
+                }
+        });
+        _manager.setPacing (pacing);
+        _manager.forEachComponent ([&] (const size_t index, const Categories, auto &component) {
+            const uint8_t frames = _counts [component.getCommand ()];
+            const bool enabled = (_manager.getEnabledComponents () >> index) & 1;
+            if (frames > 0 && (! enabled || static_cast<const RequestResponse &> (component).isValid ())) {
+                _profile.responding |= (1u << index);
+                _profile.frames [index] = frames;
+            }
+        });
+        apply (_profile);
+        return _profile.responding != 0;
+    }
+    void apply (const Profile &profile) {
+        _manager.forEachComponent ([&] (const size_t index, const Categories, auto &component) {
+            if constexpr (requires { component.setLength (size_t {}); })
+                if (profile.frames [index] > 0)
+                    component.setLength (profile.frames [index]);
+        });
+        _manager.setResponding (profile.responding);
+    }
+
+    const Profile &getProfile () const {
+        return _profile;
+    }
+    bool isRestored () const {
+        return _restored;
+    }
+    // capabilities evidenced by a response specific to them, ignoring those shared by several
+    Capabilities capabilities () const {
+        Capabilities result = Capabilities::None;
+        _manager.forEachComponent ([&] (const size_t index, const Categories, auto &component) {
+            constexpr Capabilities specified = ComponentSpecification<std::decay_t<decltype (component)>>::capabilities;
+            constexpr auto bits = static_cast<unsigned> (specified);
+            if ((_profile.responding >> index) & 1)
+                if constexpr ((bits & (bits - 1)) == 0)
+                    result = result + specified;
+        });
+        return result;
+    }
+
+private:
+    static constexpr bool IDENTIFIABLE = ! is_request_response_disabled<decltype (std::declval<MANAGER &> ().information.hardware)>::value && ! is_request_response_disabled<decltype (std::declval<MANAGER &> ().information.software)>::value;
+    String identify (const Config &config) {
+        if constexpr (IDENTIFIABLE) {
+            const auto pacing = _manager.getPacing ();
+            _manager.setPacing ({ pacing.gap, pacing.depth, config.timeout });
+            _manager.issue (_manager.information.hardware);
+            _manager.issue (_manager.information.software);
+            settle ();
+            _manager.setPacing (pacing);
+        }
+        return identified ();
+    }
+    String identified () const {
+        if constexpr (IDENTIFIABLE)
+            if (static_cast<const RequestResponse &> (_manager.information.hardware).isValid () && static_cast<const RequestResponse &> (_manager.information.software).isValid ())
+                return _manager.information.hardware.string + "/" + _manager.information.software.string;
+        return String ();
+    }
+    Identity identityLengths () const {
+        Identity lengths;
+        if constexpr (IDENTIFIABLE) {
+            lengths.hardware = static_cast<uint8_t> (_manager.information.hardware.getResponseFrameCount ());
+            lengths.software = static_cast<uint8_t> (_manager.information.software.getResponseFrameCount ());
+        }
+        return lengths;
+    }
+    void applyIdentity (const Identity &lengths) {
+        if constexpr (IDENTIFIABLE) {
+            _manager.information.hardware.setLength (lengths.hardware);
+            _manager.information.software.setLength (lengths.software);
+        }
+    }
+    void issue (const Categories categories) {
+        _manager.forEachComponent ([&] (const size_t, const Categories category, auto &component) {
+            if ((category & categories) != Categories::None)
+                _manager.issue (component);
+        });
+        settle ();
+    }
+    void settle () {
+        do {
+            _manager.process ();
+            delay (1);
+        } while (! _manager.isIdle ());
+    }
+    bool handleFrame (RequestResponseFrame::Receiver::Handler::Type frame) {
+        if (frame.second == Direction::Receive && _counts [frame.first.getCommand ()] < 0xFF)
+            _counts [frame.first.getCommand ()]++;
+        return false;
+    }
+
+    MANAGER &_manager;
+    RequestResponseFrame::Receiver &_connector;
+    std::array<uint8_t, 256> _counts {};
+    Profile _profile {};
+    bool _restored {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
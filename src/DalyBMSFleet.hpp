@@ -0,0 +1,208 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// the state of many packs held by column: one contiguous array per quantity indexed by pack, and a
+// packs x cells matrix of cell voltages, written in place from each attached manager's responses
+// (or directly, by update ()). Queries are simple loops over a column, which compilers unroll or
+// vectorise, rather than walks through every interface and manager: top-K, threshold scans and
+// histograms. Values not yet known are NaN, which no threshold or histogram counts
+
+template <typename MANAGER>
+class FleetStore {
+public:
+    enum class Column : uint8_t {
+        Voltage,      // 0x90, volts
+        Current,      // 0x90, amps
+        Charge,       // 0x90, percent
+        CellMax,      // 0x91, volts
+        CellMin,      // 0x91
+        CellDelta,    // 0x91, max - min
+        SensorMax,    // 0x92, celsius
+        SensorMin,    // 0x92
+        Count
+    };
+    static constexpr size_t COLUMNS = static_cast<size_t> (Column::Count);
+
+    FleetStore (const size_t packs, const size_t cells) :
+        _packs (packs),
+        _cells (cells),
+        _matrix (packs * cells, NAN),
+        _updated (packs, 0) {
+        for (auto &column : _columns)
+            column.assign (packs, NAN);
+        _bindings.reserve (packs);    // never reallocated, as bindings are subscription contexts
+    }
+    ~FleetStore () {
+        for (auto &binding : _bindings)
+            binding.manager->unsubscribe (&binding);
+    }
+    FleetStore (const FleetStore &) = delete;
+    FleetStore &operator= (const FleetStore &) = delete;
+
+    // the manager's status, extremes and cell voltages then update the pack's row as they arrive;
+    // false if the pack is out of range or the manager's subscription pool was full
+    bool attach (const size_t pack, MANAGER &manager) {
+        if (pack >= _packs || _bindings.size () == _bindings.capacity ())
+            return false;
+        Binding &binding = _bindings.emplace_back (Binding { this, &manager, pack });
+        return manager.template subscribe<&Binding::handle> (&binding, Categories::Conditions + Categories::Diagnostics);
+    }
+    void update (const size_t pack, const Column column, const float value) {
+        if (pack >= _packs || column >= Column::Count)
+            return;
+        _columns [static_cast<size_t> (column)][pack] = value;
+        _updated [pack] = systemTicksNow ();
+    }
+    void updateCells (const size_t pack, const float *voltages, const size_t count) {
+        if (pack >= _packs)
+            return;
+        std::copy_n (voltages, std::min (count, _cells), &_matrix [pack * _cells]);
+        _updated [pack] = systemTicksNow ();
+    }
+
+    size_t packs () const {
+        return _packs;
+    }
+    size_t cells () const {
+        return _cells;
+    }
+    const float *column (const Column column) const {
+        return _columns [static_cast<size_t> (column)].data ();
+    }
+    const float *cellsOf (const size_t pack) const {    // the pack's row of cell voltages
+        return &_matrix [pack * _cells];
+    }
+    SystemTicks_t updated (const size_t pack) const {
+        return _updated [pack];
+    }
+
+    // the packs with the k highest (or lowest) values, best first, returning how many were found
+    size_t topK (const Column column, const size_t k, size_t *packs, const bool highest = true) const {
+        if (k == 0)
+            return 0;
+        const float *values = this->column (column);
+        size_t found = 0;
+        for (size_t pack = 0; pack < _packs; pack++) {
+            const float value = values [pack];
+            if (std::isnan (value))
+                continue;
+            if (found == k && ! (highest ? value > values [packs [k - 1]] : value < values [packs [k - 1]]))
+                continue;
+            size_t at = found < k ? found++ : k - 1;    // insert in order, dropping the last when full
+            while (at > 0 && (highest ? value > values [packs [at - 1]] : value < values [packs [at - 1]])) {
+                packs [at] = packs [at - 1];
+                at--;
+            }
+            packs [at] = pack;
+        }
+        return found;
+    }
+    // the packs whose value is above (or below) the threshold, in order, returning how many; at
+    // most capacity are written, but all are counted
+    size_t scan (const Column column, const float threshold, size_t *packs, const size_t capacity, const bool above = true) const {
+        const float *values = this->column (column);
+        size_t found = 0;
+        for (size_t pack = 0; pack < _packs; pack++)
+            if (above ? values [pack] > threshold : values [pack] < threshold) {
+                if (found < capacity)
+                    packs [found] = pack;
+                found++;
+            }
+        return found;
+    }
+    // counts values into bins evenly spanning [minimum, maximum), clamping those outside into the
+    // end bins; returns how many were counted
+    template <size_t BINS>
+    size_t histogram (const Column column, const float minimum, const float maximum, std::array<counter_t, BINS> &bins) const {
+        const float *values = this->column (column);
+        const float scale = BINS / (maximum - minimum);
+        size_t counted = 0;
+        bins.fill (0);
+        for (size_t pack = 0; pack < _packs; pack++) {
+            const float value = values [pack];
+            if (std::isnan (value))
+                continue;
+            const long bin = static_cast<long> ((value - minimum) * scale);
+            bins [static_cast<size_t> (std::min (std::max (bin, 0L), static_cast<long> (BINS) - 1))]++;
+            counted++;
+        }
+        return counted;
+    }
+    // every cell above (or below) the threshold, as visitor (pack, cell from 0, voltage)
+    template <typename VISITOR>
+    size_t scanCells (const float threshold, VISITOR &&visitor, const bool above = true) const {
+        size_t found = 0;
+        for (size_t index = 0; index < _matrix.size (); index++)
+            if (above ? _matrix [index] > threshold : _matrix [index] < threshold) {
+                visitor (index / _cells, index % _cells, _matrix [index]);
+                found++;
+            }
+        return found;
+    }
+
+private:
+    struct Binding {
+        FleetStore *store;
+        MANAGER *manager;
+        size_t pack;
+        bool handle (RequestResponse &response) {
+            store->receive (pack, response);
+            return false;
+        }
+    };
+
+    void receive (const size_t pack, RequestResponse &response) {
+        switch (response.getCommand ()) {
+        case 0x90 :
+            update (pack, Column::Voltage, response.get (&RequestResponse_STATUS::voltage));
+            update (pack, Column::Current, response.get (&RequestResponse_STATUS::current));
+            update (pack, Column::Charge, response.get (&RequestResponse_STATUS::charge));
+            break;
+        case 0x91 : {
+            const auto &value = response.get (&RequestResponse_VOLTAGE_MINMAX::value);
+            update (pack, Column::CellMax, value.max);
+            update (pack, Column::CellMin, value.min);
+            update (pack, Column::CellDelta, value.max - value.min);
+        } break;
+        case 0x92 : {
+            const auto &value = response.get (&RequestResponse_SENSOR_MINMAX::value);
+            update (pack, Column::SensorMax, value.max);
+            update (pack, Column::SensorMin, value.min);
+        } break;
+        case 0x95 : {
+            const auto &values = response.get (&RequestResponse_VOLTAGES::values);
+            updateCells (pack, values.data (), values.size ());
+        } break;
+        default :
+            break;
+        }
+    }
+
+    const size_t _packs, _cells;
+    std::array<std::vector<float>, COLUMNS> _columns {};
+    std::vector<float> _matrix;
+    std::vector<SystemTicks_t> _updated;
+    std::vector<Binding> _bindings {};
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -0,0 +1,222 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <vector>
+
+#ifndef DALYBMS_FUSION_CELLS
+#define DALYBMS_FUSION_CELLS 48    // as many as 0x95 can carry
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct FusedCell {
+    float voltage { NAN };
+    SystemTicks_t age {};    // of the newest sample used
+    uint8_t sources {};      // used, as bits by source
+    bool disagree {};        // fresh samples from two sources differ beyond the tolerance
+    bool stale {};           // no source fresh, so the newest sample at all
+};
+
+// one view of cell voltages measured by several ports wired to the same cells (e.g. the manager
+// and the balancer): each cell keeps the latest sample from each source, from cell voltages (0x95)
+// and from the extremes (0x91), and is read as the freshest of them or as their mean weighted by
+// age. A source quiet for longer than the maximum age drops out, so the other carries on alone;
+// fresh samples differing beyond the tolerance flag the cell. Optionally the cell voltages are
+// requested from each source in turn, so the view is refreshed N times as often as each link is
+// asked, at no extra load on any
+
+template <typename MANAGER, size_t CELLS = DALYBMS_FUSION_CELLS>
+class CellFusion {
+public:
+    enum class Mode : uint8_t {
+        Freshest,
+        Weighted    // by 1 - age / maximum age
+    };
+    struct Config {
+        Mode mode { Mode::Weighted };
+        SystemTicks_t maximum { 10000 };    // age beyond which a source's sample is not used
+        float tolerance { 0.010f };        // volts between fresh samples before they disagree
+        SystemTicks_t interleave {};        // when set, requests 0x95 from the next source every interleave / sources
+    };
+    static constexpr size_t SOURCES = 8;
+
+    CellFusion (const std::vector<MANAGER *> &managers, const Config &config = Config ()) :
+        _config (config) {
+        for (size_t index = 0; index < std::min (managers.size (), SOURCES); index++) {
+            MANAGER *manager = managers [index];
+            _sources.push_back ({ manager });
+            if constexpr (! is_request_response_disabled<decltype (manager->diagnostics.voltages)>::value) {
+                _subscribed = manager->template subscribe<&CellFusion::handleVoltages> (this, manager->diagnostics.voltages) && _subscribed;
+                if (_config.interleave > 0) {
+                    _sources.back ().refreshed = manager->diagnostics.voltages.isRefreshed ();
+                    manager->diagnostics.voltages.setRefreshed (false);    // requested here instead, fresh as before
+                }
+            }
+            if constexpr (! is_request_response_disabled<decltype (manager->conditions.voltage)>::value)
+                _subscribed = manager->template subscribe<&CellFusion::handleExtremes> (this, manager->conditions.voltage) && _subscribed;
+        }
+    }
+    ~CellFusion () {
+        for (auto &source : _sources) {
+            if constexpr (! is_request_response_disabled<decltype (source.manager->diagnostics.voltages)>::value)
+                if (_config.interleave > 0)
+                    source.manager->diagnostics.voltages.setRefreshed (source.refreshed);
+            source.manager->unsubscribe (this);
+        }
+    }
+    CellFusion (const CellFusion &) = delete;
+    CellFusion &operator= (const CellFusion &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    void process () {
+        if (_config.interleave == 0 || _sources.empty ())
+            return;
+        const SystemTicks_t now = systemTicksNow ();
+        if (now - _interleaved < _config.interleave / _sources.size ())
+            return;
+        _interleaved = now;
+        _next = (_next + 1) % _sources.size ();
+        if constexpr (! is_request_response_disabled<decltype (_sources [_next].manager->diagnostics.voltages)>::value)
+            _sources [_next].manager->issue (_sources [_next].manager->diagnostics.voltages);
+    }
+
+    size_t size () const {    // cells seen from any source
+        return _cells;
+    }
+    FusedCell cell (const size_t index) const {
+        FusedCell result;
+        if (index >= _cells)
+            return result;
+        const SystemTicks_t now = systemTicksNow ();
+        const Sample *freshest = nullptr;
+        float weighted = 0.0f, weights = 0.0f;
+        for (size_t source = 0; source < _sources.size (); source++) {
+            const Sample &sample = _sources [source].samples [index];
+            if (sample.time == 0)
+                continue;
+            const SystemTicks_t age = now - sample.time;
+            if (freshest == nullptr || static_cast<long> (sample.time - freshest->time) > 0)
+                freshest = &sample;
+            if (age > _config.maximum)
+                continue;
+            const float weight = _config.mode == Mode::Weighted ? 1.0f - static_cast<float> (age) / static_cast<float> (_config.maximum + 1) : 1.0f;
+            weighted += weight * sample.voltage;
+            weights += weight;
+            result.sources |= (1u << source);
+        }
+        if (freshest == nullptr)
+            return result;
+        result.age = now - freshest->time;
+        if (result.sources == 0 || _config.mode == Mode::Freshest || weights <= 0.0f) {
+            result.voltage = freshest->voltage;
+            result.stale = result.sources == 0;
+        } else
+            result.voltage = weighted / weights;
+        result.disagree = _disagree.test (index);
+        return result;
+    }
+    const std::bitset<CELLS> &disagreements () const {
+        return _disagree;
+    }
+    counter_t disagreed () const {    // cells that began to disagree, in total
+        return _disagreed;
+    }
+    counter_t samples (const size_t source) const {
+        return source < _sources.size () ? _sources [source].received : 0;
+    }
+
+private:
+    struct Sample {
+        float voltage {};
+        SystemTicks_t time {};
+    };
+    struct Source {
+        MANAGER *manager;
+        std::array<Sample, CELLS> samples {};
+        counter_t received {};
+        bool refreshed {};
+    };
+
+    size_t find (const RequestResponse &response, const bool voltages) const {
+        for (size_t source = 0; source < _sources.size (); source++) {
+            const RequestResponse *candidate = nullptr;
+            if constexpr (! is_request_response_disabled<decltype (_sources [source].manager->diagnostics.voltages)>::value)
+                if (voltages)
+                    candidate = &_sources [source].manager->diagnostics.voltages;
+            if constexpr (! is_request_response_disabled<decltype (_sources [source].manager->conditions.voltage)>::value)
+                if (! voltages)
+                    candidate = &_sources [source].manager->conditions.voltage;
+            if (candidate == &response)
+                return source;
+        }
+        return SOURCES;
+    }
+    bool handleVoltages (RequestResponse &response) {
+        const size_t source = find (response, true);
+        if (source < _sources.size ()) {
+            const auto &values = response.get (&RequestResponse_VOLTAGES::values);
+            const SystemTicks_t now = systemTicksNow ();
+            for (size_t index = 0; index < std::min (values.size (), CELLS); index++)
+                sample (source, index, values [index], now);
+            _sources [source].received++;
+        }
+        return false;
+    }
+    bool handleExtremes (RequestResponse &response) {
+        const size_t source = find (response, false);
+        if (source < _sources.size ()) {
+            const auto &value = response.get (&RequestResponse_VOLTAGE_MINMAX::value);
+            const auto &number = response.get (&RequestResponse_VOLTAGE_MINMAX::cellNumber);
+            const SystemTicks_t now = systemTicksNow ();
+            if (number.max > 0 && number.max <= CELLS)
+                sample (source, number.max - 1, value.max, now);
+            if (number.min > 0 && number.min <= CELLS)
+                sample (source, number.min - 1, value.min, now);
+        }
+        return false;
+    }
+    void sample (const size_t source, const size_t index, const float voltage, const SystemTicks_t now) {
+        _sources [source].samples [index] = { voltage, now };
+        _cells = std::max (_cells, index + 1);
+        bool disagree = false;
+        for (size_t other = 0; other < _sources.size (); other++) {
+            const Sample &compared = _sources [other].samples [index];
+            if (other != source && compared.time != 0 && now - compared.time <= _config.maximum && std::fabs (compared.voltage - voltage) > _config.tolerance)
+                disagree = true;
+        }
+        if (disagree && ! _disagree.test (index)) {
+            _disagreed++;
+            DALYBMS_DEBUG_PRINTF ("DalyBMS: fusion cell %u disagrees, %.3fV from source %u\n", static_cast<unsigned> (index + 1), voltage, static_cast<unsigned> (source));
+        }
+        _disagree.set (index, disagree);
+    }
+
+    const Config _config;
+    std::vector<Source> _sources {};
+    std::bitset<CELLS> _disagree {};
+    counter_t _disagreed {};
+    size_t _cells {}, _next {};
+    SystemTicks_t _interleaved {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
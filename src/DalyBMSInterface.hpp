@@ -7,11 +7,23 @@
 #include "DalyBMSUtilities.hpp"
 #include "DalyBMSManager.hpp"
 #include "DalyBMSConnector.hpp"
+#include "DalyBMSStore.hpp"
+#include "DalyBMSCache.hpp"
+#include "DalyBMSSnapshot.hpp"
+#include "DalyBMSFusion.hpp"
+#include "DalyBMSBank.hpp"
 #include "DalyBMSConverterDebug.hpp"
 #include "DalyBMSConverterJson.hpp"
 #endif
 
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifndef DALYBMS_WORKER_IDLE_MS
+#define DALYBMS_WORKER_IDLE_MS 5
+#endif
 
 namespace daly_bms {
 
@@ -22,38 +34,66 @@ struct Interface {
     static inline constexpr const char *TYPE_MANAGER = "manager";
     static inline constexpr const char *TYPE_BALANCE = "balance";
 
+    enum class Role : uint8_t {
+        Unspecified,    // resolved from the id: TYPE_MANAGER or TYPE_BALANCE, optionally suffixed
+        Manager,
+        Balancer
+    };
     struct Config {
         Manager::Config manager;
         gpio_num_t PIN_EN;
+        size_t pack {};    // packs in parallel in a bank, each with a manager and optionally a balancer
+        Role role { Role::Unspecified };
     };
     const Config &config;
+    const Role role;
 
     using Connector = StreamConnector;
 
-    Connector connector;
-    Manager manager;
+    // with workers (see Interfaces::begin), the connector's read state and buffers are written by a
+    // worker and the manager by the application thread, so each starts on its own cache line
+    alignas (DALYBMS_CACHE_LINE) Connector connector;
+    alignas (DALYBMS_CACHE_LINE) Manager manager;
+    std::unique_ptr<Cache<Manager>> cache;    // only given a store, as it takes a handler of the connector
     Enableable started;
 
     explicit Interface (const Config &c, Stream &s) :
         config (c),
+        role (resolve (c)),
         connector (s),
         manager (config.manager, connector) {
     }
+    static Role resolve (const Config &config) {    // once, rather than comparing ids whenever the role matters
+        if (config.role != Role::Unspecified)
+            return config.role;
+        if (config.manager.id.startsWith (TYPE_MANAGER))
+            return Role::Manager;
+        if (config.manager.id.startsWith (TYPE_BALANCE))
+            return Role::Balancer;
+        return Role::Unspecified;
+    }
     void _enable (bool enabled) {
         if (config.PIN_EN != GPIO_NUM_NC) {
             pinMode (config.PIN_EN, OUTPUT);
             digitalWrite (config.PIN_EN, enabled ? LOW : HIGH);    // Active-LOW
         }
     }
-    void begin () {
+    // with a store, initial responses kept from the last session are restored rather than requested
+    void begin (Store *store = nullptr) {
         _enable (true);
         manager.begin ();
         if (! started) {
-            manager.requestInitial ();
-            manager.requestConditions ();
+            if (store != nullptr)
+                cache = std::make_unique<Cache<Manager>> (manager, connector);
+            manager.requestStartup (cache == nullptr || ! cache->begin (*store));
             started++;
         }
     }
+    void process () {
+        manager.process ();
+        if (cache != nullptr)
+            cache->process ();
+    }
     void end () {
         manager.end ();
         _enable (false);
@@ -63,6 +103,18 @@ struct Interface {
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
 
+// what Interfaces aggregates across its interfaces beyond the managers themselves, each subscribing
+// to them and processed with them, so only when asked for
+enum class Aggregation : uint8_t {
+    None = 0,
+    Snapshot = 1 << 0,    // see SnapshotBarrier
+    Fusion = 1 << 1,      // see CellFusion
+    Bank = 1 << 2,        // see Bank
+    All = Snapshot | Fusion | Bank
+};
+template <>
+struct is_flags_enum<Aggregation> : std::true_type { };
+
 class Interfaces {
 
 private:
@@ -74,6 +126,10 @@ private:
     const Configs &configs;
     const Interfacez interfaces;
     const Managers managers;
+    const Managers primaries;    // in the manager role
+    const std::unique_ptr<SnapshotBarrier<Manager>> barrier;    // each only given its Aggregation
+    const std::unique_ptr<CellFusion<Manager>> fusion;
+    const std::unique_ptr<Bank<Manager>> bank;
 
     static Interfacez makeInterfaces (const Configs &configs, const Streams &streams) {
         Interfacez result;
@@ -82,6 +138,44 @@ private:
             result.push_back (std::make_shared<Interface> (configs [i], *streams [i]));
         return result;
     }
+    // per-interface queue from a worker, whose producer and consumer ends are on their own cache
+    // lines (see SpscQueue); the connector it drains is isolated within the Interface
+    struct Lane {
+        Interface::Connector &connector;
+        Interface::Connector::Queue queue {};
+        explicit Lane (Interface::Connector &c) :
+            connector (c) { }
+    };
+    using Lanes = std::vector<std::unique_ptr<Lane>>;
+    const Lanes lanes;
+    std::vector<std::thread> workers;
+    std::atomic<bool> working { false };
+
+    static Lanes makeLanes (const Interfacez &interfaces) {
+        Lanes result;
+        result.reserve (interfaces.size ());
+        for (const auto &interface : interfaces)
+            result.push_back (std::make_unique<Lane> (interface->connector));
+        return result;
+    }
+    void startWorkers (const size_t count) {
+        working = true;
+        for (size_t index = 0; index < count; index++)
+            workers.emplace_back ([this, index, count] () {
+                while (working.load (std::memory_order_relaxed)) {
+                    for (size_t i = index; i < lanes.size (); i += count)
+                        lanes [i]->connector.drain ();
+                    std::this_thread::sleep_for (std::chrono::milliseconds (DALYBMS_WORKER_IDLE_MS));
+                }
+            });
+    }
+    void stopWorkers () {
+        working = false;
+        for (auto &worker : workers)
+            worker.join ();
+        workers.clear ();
+    }
+
     static Managers makeManagers (const Interfacez &interfaces) {
         Managers result;
         result.reserve (interfaces.size ());
@@ -89,30 +183,102 @@ private:
             result.push_back (&interface->manager);
         return result;
     }
+    static Managers makePrimaries (const Interfacez &interfaces) {
+        Managers result;
+        for (const auto &interface : interfaces)
+            if (interface->role == Interface::Role::Manager)
+                result.push_back (&interface->manager);
+        return result;
+    }
+    // cell voltages from every port, and the status from the manager, in one snapshot
+    static SnapshotBarrier<Manager>::Config makeSnapshot (const Interfacez &interfaces) {
+        SnapshotBarrier<Manager>::Config result;
+        for (size_t index = 0; index < interfaces.size (); index++) {
+            if (interfaces [index]->role == Interface::Role::Manager)
+                result.sources.push_back ({ index, 0x90 });
+            result.sources.push_back ({ index, 0x95 });
+        }
+        return result;
+    }
+    static std::vector<Bank<Manager>::Pack> makePacks (const Interfacez &interfaces) {
+        std::vector<Bank<Manager>::Pack> result;
+        for (const auto &interface : interfaces)
+            if (interface->role == Interface::Role::Manager) {
+                if (interface->config.pack >= result.size ())
+                    result.resize (interface->config.pack + 1, { nullptr });
+                result [interface->config.pack].manager = &interface->manager;
+            }
+        for (const auto &interface : interfaces)
+            if (interface->role == Interface::Role::Balancer && interface->config.pack < result.size ())
+                result [interface->config.pack].balancer = &interface->manager;
+        result.erase (std::remove_if (result.begin (), result.end (), [] (const auto &pack) { return pack.manager == nullptr; }), result.end ());
+        return result;
+    }
 
 public:
-    explicit Interfaces (const Configs &c, const Streams s) :
+    explicit Interfaces (const Configs &c, const Streams s, const Aggregation aggregation = Aggregation::None) :
         configs (c),
         interfaces (makeInterfaces (c, s)),
-        managers (makeManagers (interfaces)) {
+        managers (makeManagers (interfaces)),
+        primaries (makePrimaries (interfaces)),
+        barrier ((aggregation & Aggregation::Snapshot) != Aggregation::None ? std::make_unique<SnapshotBarrier<Manager>> (managers, makeSnapshot (interfaces)) : nullptr),
+        fusion ((aggregation & Aggregation::Fusion) != Aggregation::None ? std::make_unique<CellFusion<Manager>> (managers) : nullptr),
+        bank ((aggregation & Aggregation::Bank) != Aggregation::None ? std::make_unique<Bank<Manager>> (makePacks (interfaces)) : nullptr),
+        lanes (makeLanes (interfaces)) {
+    }
+
+    ~Interfaces () {
+        stopWorkers ();
     }
 
-    bool begin () {
+    // workers > 0 drains the connectors on that many threads (one per interface at most, assigned
+    // round-robin) into per-interface queues, and process () then only dispatches from the queues;
+    // a store keeps the initial responses across restarts (see Cache)
+    bool begin (const size_t workers = 0, Store *store = nullptr) {
+        if (workers > 0)
+            for (const auto &lane : lanes)
+                lane->connector.defer (&lane->queue);
         for (const auto &interface : interfaces)
-            interface->begin ();
+            interface->begin (store);
+        if (workers > 0)
+            startWorkers (std::min (workers, interfaces.size ()));
         process ();
         return true;
     }
     void end () {
+        stopWorkers ();
         process ();
         for (const auto &interface : interfaces)
             interface->end ();
+        for (const auto &lane : lanes)
+            lane->connector.defer (nullptr);
+    }
+    size_t overflows () const {
+        size_t count = 0;
+        for (const auto &lane : lanes)
+            count += lane->queue.overflows ();
+        return count;
     }
 
     //
 
     void process () {
-        forEachManager<&Manager::process> ();
+        for (const auto &interface : interfaces)
+            interface->process ();
+        if (barrier != nullptr)
+            barrier->process ();
+        if (fusion != nullptr)
+            fusion->process ();
+        if (bank != nullptr)
+            bank->process ();
+    }
+    // one coherent capture across the interfaces, published to the snapshot's handlers when complete;
+    // this and the other aggregates are null, and requests for them fail, unless constructed with them
+    bool requestSnapshot () {
+        return barrier != nullptr && barrier->capture ();
+    }
+    SnapshotBarrier<Manager> *snapshot () {
+        return barrier.get ();
     }
     void requestInitial () {
         forEachManager<&Manager::requestInitial> ();
@@ -149,10 +315,6 @@ public:
         return false;
     }
 
-    static constexpr bool is_manager (const Manager *manager) {
-        return manager->getConfig ().id == Interface::TYPE_MANAGER;
-    }
-
     struct Status {
         interval_t timestamp = 0;
         float chargePercentage = 0.0f;
@@ -165,24 +327,26 @@ public:
         int failureCount = -1;
         String failureList;
     };
+    // from fresh responses only, so a device gone silent shows as such rather than as its last values
     bool getStatus (Status &s) const {
         bool result = false;
-        for (auto &manager : managers) {
-            if (is_manager (manager)) {
+        for (const auto &interface : interfaces) {
+            const Manager *manager = &interface->manager;
+            if (interface->role == Interface::Role::Manager) {
                 const auto &instant_status = manager->conditions.status;
-                if (instant_status.isValid ()) {
+                if (instant_status.decode () && instant_status.isFresh ()) {
                     s.timestamp = instant_status.valid ();
                     s.chargePercentage = instant_status.charge;
                     result = true;
                 }
                 const auto &instant_mosfet = manager->conditions.mosfet;
-                if (instant_mosfet.isValid ()) {
+                if (instant_mosfet.decode () && instant_mosfet.isFresh ()) {
                     s.mosCharge = instant_mosfet.mosChargeState ? Status::MosState::On : Status::MosState::Off;
                     s.mosDischarge = instant_mosfet.mosDischargeState ? Status::MosState::On : Status::MosState::Off;
                 }
             }
             const auto &instant_failure = manager->conditions.failure;
-            if (instant_failure.isValid () && instant_failure.count > 0) {
+            if (instant_failure.decode () && instant_failure.isFresh () && instant_failure.count > 0) {
                 s.failureCount = (s.failureCount == -1 ? 0 : s.failureCount) + instant_failure.count;
                 const String failureString = instant_failure.toString ();
                 s.failureList += (! s.failureList.isEmpty () && ! failureString.isEmpty () ? "," : "") + failureString;
@@ -191,28 +355,28 @@ public:
         return result;
     }
     const daly_bms::Manager::Conditions *getConditions () const {
-        for (auto &manager : managers)
-            if (is_manager (manager))
-                return &manager->conditions;
-        return nullptr;
+        return primaries.empty () ? nullptr : &primaries.front ()->conditions;
+    }
+    // cell voltages from every interface measuring them, see CellFusion
+    const CellFusion<Manager> *getCellVoltages () const {
+        return fusion.get ();
+    }
+    // packs in parallel, aggregated as responses arrive, see Bank
+    const Bank<Manager> *getBank () const {
+        return bank.get ();
     }
     const daly_bms::Manager::Diagnostics *getDiagnostics () const {
-        for (auto &manager : managers)
-            if (is_manager (manager))
-                return &manager->diagnostics;
-        return nullptr;
+        return primaries.empty () ? nullptr : &primaries.front ()->diagnostics;
     }
 
     bool setChargeMOSFET (const bool state) {
-        for (auto &manager : managers)
-            if (is_manager (manager))
-                manager->command (manager->commands.charge, state ? RequestResponse_MOSFET_CHARGE::Setting::On : RequestResponse_MOSFET_CHARGE::Setting::Off);
+        for (auto &manager : primaries)
+            manager->command (manager->commands.charge, state ? RequestResponse_MOSFET_CHARGE::Setting::On : RequestResponse_MOSFET_CHARGE::Setting::Off);
         return false;
     }
     bool setDischargeMOSFET (const bool state) {
-        for (auto &manager : managers)
-            if (is_manager (manager))
-                manager->command (manager->commands.discharge, state ? RequestResponse_MOSFET_DISCHARGE::Setting::On : RequestResponse_MOSFET_DISCHARGE::Setting::Off);
+        for (auto &manager : primaries)
+            manager->command (manager->commands.discharge, state ? RequestResponse_MOSFET_DISCHARGE::Setting::On : RequestResponse_MOSFET_DISCHARGE::Setting::Off);
         return false;
     }
 
@@ -230,31 +394,36 @@ public:
     }
     String status () const {
         String s;
-        for (auto &manager : managers) {
+        for (const auto &interface : interfaces) {
+            const Manager *manager = &interface->manager;
             const auto &config = manager->getConfig ();
             const auto &status = manager->getStatus ();
 
             s += (s.isEmpty () ? "" : ", ") + String ("daly<") + config.id + ">: last=" + String (status.received.seconds ());
-            if (is_manager (manager)) {
+            if (status.startupFull > 0)
+                s += ", startup=" + String (static_cast<unsigned long> (status.startupStatus)) + "/" + String (static_cast<unsigned long> (status.startupFull)) + "ms";
+            if (interface->role == Interface::Role::Manager) {
                 const auto &instant_status = manager->conditions.status;
                 const auto &instant_mosfet = manager->conditions.mosfet;
                 const auto &battery_ratings = manager->information.battery_ratings;
                 s += ", status=" + instant_status.toString ();
-                if (instant_mosfet.isValid ()) {
+                if (instant_mosfet.decode ()) {
                     s += ", capacity=" + String (instant_mosfet.residualCapacityAh, 1);
-                    if (battery_ratings.isValid ())
+                    if (battery_ratings.decode ())
                         s += "/" + String (battery_ratings.packCapacityAh, 1);
                     s += "Ah";
                     s += ", state=" + toString (instant_mosfet.state);
                 }
                 const auto &instant_info = manager->conditions.information;
-                if (instant_info.isValid ())
+                if (instant_info.decode ())
                     s += ", charger=" + String (instant_info.chargerStatus ? "ON" : "OFF") + "/load=" + String (instant_info.loadStatus ? "ON" : "OFF");
             }
             const auto &failures = manager->conditions.failure;
-            if (failures.isValid () && failures.count > 0)
+            if (failures.decode () && failures.count > 0)
                 s += ", failures=[" + failures.toString () + "] ";
         }
+        if (barrier != nullptr && barrier->stats ().captures > 0)
+            s += ", snapshot skew=" + String (static_cast<unsigned long> (barrier->stats ().skewLast)) + "/" + String (static_cast<unsigned long> (barrier->stats ().skewMax)) + "ms";
         return s;
     }
 
@@ -264,17 +433,17 @@ public:
             const auto &config = manager->getConfig ();
             double nominalCellVoltage = 0;
             String t;
-            if (manager->information.hardware.isValid ())
+            if (manager->information.hardware.decode ())
                 t += String (t.isEmpty () ? "" : ", ") + "hardware=" + manager->information.hardware.string;
-            if (manager->information.firmware.isValid ())
+            if (manager->information.firmware.decode ())
                 t += String (t.isEmpty () ? "" : ", ") + "firmware=" + manager->information.firmware.string;
-            if (manager->information.software.isValid ())
+            if (manager->information.software.decode ())
                 t += String (t.isEmpty () ? "" : ", ") + "software=" + manager->information.software.string;
-            if (manager->information.battery_ratings.isValid ()) {
+            if (manager->information.battery_ratings.decode ()) {
                 t += String (t.isEmpty () ? "" : ", ") + "battery=" + String (manager->information.battery_ratings.packCapacityAh, 1) + "Ah/" + String (nominalCellVoltage = manager->information.battery_ratings.nominalCellVoltage, 1) + "V";
-                if (manager->information.battery_info.isValid ())
+                if (manager->information.battery_info.decode ())
                     t += "/" + toString (manager->information.battery_info.type);
-                if (manager->information.config.isValid ()) {
+                if (manager->information.config.decode ()) {
                     int cells = 0;
                     for (const auto &c : manager->information.config.cells)
                         cells += c;
@@ -9,8 +9,14 @@
 #include "DalyBMSRequestResponseTypes.hpp"
 #endif
 
+#include <array>
 #include <vector>
+#include <deque>
 #include <map>
+#include <tuple>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 namespace daly_bms {
 
@@ -33,20 +39,55 @@ inline String toString (const Direction &direction) {
     }
 }
 
+#ifndef DALYBMS_RECEIVE_QUEUE
+#define DALYBMS_RECEIVE_QUEUE 32
+#endif
+#ifndef DALYBMS_FRAME_HANDLERS_MAX
+#define DALYBMS_FRAME_HANDLERS_MAX 8    // the manager, and Cache, Discovery, AdaptivePolling, FlightRecorder and others observing frames
+#endif
+
 using RequestResponseFrame_Handlerable = std::pair<const RequestResponseFrame &, Direction>;
-class RequestResponseFrame_Receiver : public Handlerable<RequestResponseFrame_Handlerable, bool> {
+class RequestResponseFrame_Receiver : public Handlerable<RequestResponseFrame_Handlerable, bool, DALYBMS_FRAME_HANDLERS_MAX> {
 
 public:
+    using Received = std::pair<RequestResponseFrame, Direction>;
+    using Queue = SpscQueue<Received, DALYBMS_RECEIVE_QUEUE>;
+
     virtual void begin () = 0;
     virtual void end () = 0;
+    virtual bool carries (const uint8_t command) const {    // false for a request the link cannot send, so never configured
+        return true;
+    }
     void write (const RequestResponseFrame &frame) {
         notifyHandlers (Handler::Type (frame, Direction::Transmit));
         writeBytes (frame.data (), frame.size ());
-        read ();
+        if (! _deferred)
+            read ();
     }
     void process () {
+        if (_deferred)
+            dispatch ();
+        else
+            read ();
+    }
+
+    // deferred: a reading thread calls drain () to assemble frames into the queue, without ever
+    // waiting on handlers; process () on the consuming thread then dispatches them to handlers
+    void defer (Queue *queue) {
+        _deferred = queue;
+    }
+    void drain () {
         read ();
     }
+    size_t dispatch () {
+        size_t count = 0;
+        Received received;
+        while (_deferred && _deferred->pop (received)) {
+            notifyHandlers (Handler::Type (received.first, received.second));
+            count++;
+        }
+        return count;
+    }
 
 protected:
     virtual bool readByte (uint8_t *byte) = 0;
@@ -89,7 +130,11 @@ protected:
         _readFrame [_readOffset] = byte;
         if (++_readOffset < RequestResponseFrame::Constants::SIZE_FRAME)
             return false;
-        notifyHandlers (Handler::Type (_readFrame, _readFrame.valid () ? Direction::Receive : Direction::Error));
+        const Direction direction = _readFrame.valid () ? Direction::Receive : Direction::Error;
+        if (_deferred)
+            _deferred->push (Received (_readFrame, direction));
+        else
+            notifyHandlers (Handler::Type (_readFrame, direction));
         return true;
     }
 
@@ -103,6 +148,86 @@ private:
     ReadState _readState { ReadState::WaitingForStart };
     size_t _readOffset { RequestResponseFrame::Constants::OFFSET_BYTE_START };
     RequestResponseFrame _readFrame {};
+    Queue *_deferred {};
+};
+
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_RING_RX
+#define DALYBMS_RING_RX 2048
+#endif
+#ifndef DALYBMS_READER_IDLE_MS
+#define DALYBMS_READER_IDLE_MS 1
+#endif
+
+// any connector, with a reader thread (a FreeRTOS task on ESP32) continuously moving bytes from
+// the port into a lock-free ring, so that bursts are absorbed while the application is busy or
+// waiting; parsing still happens wherever process () is called
+
+template <typename CONNECTOR, size_t CAPACITY = DALYBMS_RING_RX>
+class BufferedConnector : public CONNECTOR {
+public:
+    using CONNECTOR::CONNECTOR;
+    ~BufferedConnector () {
+        stopReader ();
+    }
+
+    void begin () override {
+        CONNECTOR::begin ();
+        startReader ();
+    }
+    void end () override {
+        stopReader ();
+        CONNECTOR::end ();
+    }
+
+    // reader side, also usable without the thread: moves what the port has into the ring
+    size_t fill () {
+        size_t count = 0;
+        uint8_t byte;
+        while (CONNECTOR::readByte (&byte)) {
+            _ring.push (byte);
+            count++;
+        }
+        if (count > 0) {
+            const size_t size = _ring.size ();
+            if (size > _highWater.load (std::memory_order_relaxed))
+                _highWater.store (size, std::memory_order_relaxed);
+        }
+        return count;
+    }
+    size_t highWater () const {
+        return _highWater.load (std::memory_order_relaxed);
+    }
+    size_t overflows () const {
+        return _ring.overflows ();
+    }
+
+protected:
+    bool readByte (uint8_t *byte) override {
+        return _ring.pop (*byte);
+    }
+
+private:
+    void startReader () {
+        if (_reading.exchange (true))
+            return;
+        _reader = std::thread ([this] () {
+            while (_reading.load (std::memory_order_relaxed))
+                if (fill () == 0)
+                    std::this_thread::sleep_for (std::chrono::milliseconds (DALYBMS_READER_IDLE_MS));
+        });
+    }
+    void stopReader () {
+        if (! _reading.exchange (false))
+            return;
+        _reader.join ();
+    }
+
+    SpscQueue<uint8_t, CAPACITY> _ring {};
+    std::atomic<size_t> _highWater {};
+    std::atomic<bool> _reading { false };
+    std::thread _reader {};
 };
 
 // -----------------------------------------------------------------------------------------------
@@ -147,17 +272,17 @@ struct is_flags_enum<Categories> : std::true_type { };
 
 template <typename EnumType>
 requires is_flags_enum<EnumType>::value
-inline EnumType operator+ (EnumType a, EnumType b) {
+constexpr EnumType operator+ (EnumType a, EnumType b) {
     return static_cast<EnumType> (static_cast<int> (a) | static_cast<int> (b));
 }
 template <typename EnumType>
 requires is_flags_enum<EnumType>::value
-inline EnumType operator& (EnumType a, EnumType b) {
+constexpr EnumType operator& (EnumType a, EnumType b) {
     return static_cast<EnumType> (static_cast<int> (a) & static_cast<int> (b));
 }
 template <typename EnumType>
 requires is_flags_enum<EnumType>::value
-inline EnumType operator- (EnumType a, EnumType b) {
+constexpr EnumType operator- (EnumType a, EnumType b) {
     return static_cast<EnumType> (static_cast<int> (a) & ~static_cast<int> (b));
 }
 
@@ -220,22 +345,39 @@ inline String toString (Categories category) {
 
 // -----------------------------------------------------------------------------------------------
 
+#ifndef DALYBMS_SUBSCRIBERS
+#define DALYBMS_SUBSCRIBERS 8    // expected per response: sizes the subscription pool with the responses held
+#endif
+
+// what subscribers see of a manager, whatever the size of its pool
+struct RequestResponseSubscriber {
+    using Handler = Handlerable<RequestResponse &, bool>::Handler;
+    using Delegate = Handlerable<RequestResponse &, bool>::Delegate;
+    enum class Events {
+        Updated,    // every valid response
+        Changed     // valid responses whose content differs from the previous
+    };
+};
+
 // merge into below
-class RequestResponseManager : public Handlerable<RequestResponse &, bool> {
+template <size_t RESPONSES>
+class RequestResponseManager : public RequestResponseSubscriber {
 public:
+
     bool receiveFrame (const RequestResponseFrame &frame) {
         auto it = _requestsMap.find (frame.getCommand ());
         if (it != _requestsMap.end ())
-            if (it->second->processResponse (frame))
-                if (it->second->isValid ()) {
-                    notifyHandlers (*it->second);
+            if (it->second.request->processResponse (frame))
+                if (it->second.request->isValid ()) {
+                    notifySubscriptions (it->second.subscriptions, *it->second.request);
+                    notifySubscriptions (_subscriptionsAll, *it->second.request);
                     return true;
                 } else {
-                    if (it->second->isComplete ())
+                    if (it->second.request->isComplete ())
                         ALWAYS_DEBUG_PRINTF ("RequestResponseManager<%s>: frame complete but not valid\n", _id.c_str ());
                 }
             else {
-                if (it->second->isComplete ())
+                if (it->second.request->isComplete ())
                     ALWAYS_DEBUG_PRINTF ("RequestResponseManager<%s>: frame complete but unprocessable\n", _id.c_str ());
             }
         else {
@@ -244,41 +386,264 @@ public:
         return false;
     }
 
+    // all subscribed handlers are notified, regardless of what each returns; subscriptions
+    // come from a pool sized at compile time for the responses held, and fail, reported, when
+    // it is exhausted
+    bool registerHandler (const Delegate &delegate, const Events events = Events::Updated) {
+        return subscribe (_subscriptionsAll, delegate, events);
+    }
+    bool registerHandler (const Delegate &delegate, const uint8_t command, const Events events = Events::Updated) {
+        auto it = _requestsMap.find (command);
+        return it != _requestsMap.end () && subscribe (it->second.subscriptions, delegate, events);
+    }
+    template <typename CONTEXT>
+    void unregisterHandler (const CONTEXT *context) {
+        unsubscribe (_subscriptionsAll, context);
+        for (auto &[command, entry] : _requestsMap)
+            unsubscribe (entry.subscriptions, context);
+    }
+    // as on receipt, for a response made valid other than by a frame, e.g. restored from a store
+    void notify (RequestResponse &request) const {
+        auto it = _requestsMap.find (request.getCommand ());
+        if (it != _requestsMap.end () && request.isValid ()) {
+            notifySubscriptions (it->second.subscriptions, request);
+            notifySubscriptions (_subscriptionsAll, request);
+        }
+    }
+
     explicit RequestResponseManager (const String &id, const std::vector<RequestResponse *> &requests) :
         _id (id),
         _requests (requests) {
+        assert (_requests.size () <= RESPONSES);
         for (auto &request : _requests)
-            _requestsMap [request->getCommand ()] = request;
+            _requestsMap [request->getCommand ()].request = request;
+        for (size_t i = 0; i < _subscriptions.size (); i++)
+            _subscriptions [i].next = static_cast<SubscriptionIndex> (i + 1 < _subscriptions.size () ? i + 1 : SUBSCRIPTION_NONE);
+    }
+    size_t getSubscriptionCapacity () const {
+        return _subscriptions.size ();
     }
 
+    using SubscriptionIndex = uint16_t;
+    static constexpr SubscriptionIndex SUBSCRIPTION_NONE = 0xFFFF;
+    struct Subscription {
+        Delegate delegate {};
+        Events events { Events::Updated };
+        SubscriptionIndex next { SUBSCRIPTION_NONE };
+    };
+    struct Entry {
+        RequestResponse *request {};
+        SubscriptionIndex subscriptions { SUBSCRIPTION_NONE };
+    };
+
     const String _id;
     const std::vector<RequestResponse *> _requests {};
-    std::map<uint8_t, RequestResponse *> _requestsMap {};
+    std::map<uint8_t, Entry> _requestsMap {};
+
+private:
+    bool subscribe (SubscriptionIndex &list, const Delegate &delegate, const Events events) {
+        if (_subscriptionsFree == SUBSCRIPTION_NONE) {
+            ALWAYS_DEBUG_PRINTF ("RequestResponseManager<%s>: subscription pool of %u exhausted, raise DALYBMS_SUBSCRIBERS\n", _id.c_str (), static_cast<unsigned> (_subscriptions.size ()));
+            return false;
+        }
+        const SubscriptionIndex index = _subscriptionsFree;
+        _subscriptionsFree = _subscriptions [index].next;
+        _subscriptions [index] = { .delegate = delegate, .events = events, .next = SUBSCRIPTION_NONE };
+        SubscriptionIndex *tail = &list;
+        while (*tail != SUBSCRIPTION_NONE)
+            tail = &_subscriptions [*tail].next;
+        *tail = index;
+        return true;
+    }
+    template <typename CONTEXT>
+    void unsubscribe (SubscriptionIndex &list, const CONTEXT *context) {
+        for (SubscriptionIndex *link = &list; *link != SUBSCRIPTION_NONE;) {
+            const SubscriptionIndex index = *link;
+            if (_subscriptions [index].delegate.isBoundTo (context)) {
+                *link = _subscriptions [index].next;
+                _subscriptions [index].next = _subscriptionsFree;
+                _subscriptionsFree = index;
+            } else
+                link = &_subscriptions [index].next;
+        }
+    }
+    void notifySubscriptions (SubscriptionIndex index, RequestResponse &request) const {
+        for (; index != SUBSCRIPTION_NONE; index = _subscriptions [index].next)
+            if (_subscriptions [index].events == Events::Updated || request.isChanged ())
+                _subscriptions [index].delegate (request);
+    }
+
+    std::array<Subscription, std::min<size_t> ((RESPONSES + 1) * DALYBMS_SUBSCRIBERS, SUBSCRIPTION_NONE)> _subscriptions {};    // + 1 for those of every response
+    SubscriptionIndex _subscriptionsFree { 0 };
+    SubscriptionIndex _subscriptionsAll { SUBSCRIPTION_NONE };
 };
 
 // -----------------------------------------------------------------------------------------------
 
-class Manager;
-void dumpDebug (const Manager &);
+// category and capabilities of each response as held by a manager
+
+template <typename TYPE>
+struct ComponentSpecification;
+#define COMPONENT_SPECIFICATION(TYPE, CATEGORY, CAPABILITIES)            \
+    template <>                                                          \
+    struct ComponentSpecification<TYPE> {                                \
+        static constexpr Categories category = Categories::CATEGORY;     \
+        static constexpr Capabilities capabilities = CAPABILITIES;       \
+    }
+COMPONENT_SPECIFICATION (RequestResponse_BMS_CONFIG, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BMS_HARDWARE, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BMS_FIRMWARE, Information, Capabilities::FirmwareIndex);    // No response, Managing or Balancing
+COMPONENT_SPECIFICATION (RequestResponse_BMS_SOFTWARE, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BATTERY_RATINGS, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BATTERY_CODE, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BATTERY_INFO, Information, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_BATTERY_STAT, Information, Capabilities::Managing);
+COMPONENT_SPECIFICATION (RequestResponse_BMS_RTC, Information, Capabilities::RealTimeClock);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_VOLTAGE, Thresholds, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_CURRENT, Thresholds, Capabilities::Managing);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_SENSOR, Thresholds, Capabilities::TemperatureSensing);    // Balancing response, but questionable
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_CHARGE, Thresholds, Capabilities::Managing);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_CELL_VOLTAGE, Thresholds, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_CELL_SENSOR, Thresholds, Capabilities::TemperatureSensing);    // Balancing response, but questionable
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_CELL_BALANCE, Thresholds, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_THRESHOLDS_SHORTCIRCUIT, Thresholds, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_STATUS, Conditions, Capabilities::Managing);    // Balancing response, but voltage only
+COMPONENT_SPECIFICATION (RequestResponse_VOLTAGE_MINMAX, Conditions, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_SENSOR_MINMAX, Conditions, Capabilities::TemperatureSensing);    // Balancing response, is probably onboard sensor
+COMPONENT_SPECIFICATION (RequestResponse_MOSFET, Conditions, Capabilities::Managing);
+COMPONENT_SPECIFICATION (RequestResponse_INFORMATION, Conditions, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_FAILURE, Conditions, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_VOLTAGES, Diagnostics, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_SENSORS, Diagnostics, Capabilities::TemperatureSensing);
+COMPONENT_SPECIFICATION (RequestResponse_BALANCES, Diagnostics, Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_RESET, Commands, Capabilities::Managing + Capabilities::Balancing);
+COMPONENT_SPECIFICATION (RequestResponse_MOSFET_CHARGE, Commands, Capabilities::Managing);
+COMPONENT_SPECIFICATION (RequestResponse_MOSFET_DISCHARGE, Commands, Capabilities::Managing);
+
+// stands in for a response that a BasicManager compiles out: no state, decoders or converters
+
+template <typename TYPE>
+struct RequestResponseDisabled {
+    using Type = TYPE;
+    static constexpr bool isValid () {
+        return false;
+    }
+    static constexpr bool decode () {
+        return false;
+    }
+};
+template <typename TYPE>
+struct is_request_response_disabled : std::false_type { };
+template <typename TYPE>
+struct is_request_response_disabled<RequestResponseDisabled<TYPE>> : std::true_type { };
+
+template <typename TYPE, Capabilities CAPABILITIES, Categories CATEGORIES>
+using RequestResponseCompiled = std::conditional_t<
+    (ComponentSpecification<TYPE>::category & CATEGORIES) != Categories::None && (ComponentSpecification<TYPE>::capabilities & CAPABILITIES) != Capabilities::None,
+    TYPE,
+    RequestResponseDisabled<TYPE>>;
+
+template <typename COMPONENTS, size_t... INDEX>
+constexpr size_t countRequestResponsesCompiled (std::index_sequence<INDEX...>) {
+    return (0 + ... + (is_request_response_disabled<std::decay_t<std::tuple_element_t<INDEX, COMPONENTS>>>::value ? 0 : 1));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_CREDIT_RX
+#define DALYBMS_CREDIT_RX 1024    // SerialInterface::DEFAULT_SERIAL_BUFFER_RX
+#endif
+#ifndef DALYBMS_REQUEST_TIMEOUT_MS
+#define DALYBMS_REQUEST_TIMEOUT_MS 2000
+#endif
+
+#ifndef DALYBMS_TTL_INFORMATION_MS
+#define DALYBMS_TTL_INFORMATION_MS 0    // once per session
+#endif
+#ifndef DALYBMS_TTL_THRESHOLDS_MS
+#define DALYBMS_TTL_THRESHOLDS_MS 0    // once per session
+#endif
+#ifndef DALYBMS_TTL_CONDITIONS_MS
+#define DALYBMS_TTL_CONDITIONS_MS 30000
+#endif
+#ifndef DALYBMS_TTL_DIAGNOSTICS_MS
+#define DALYBMS_TTL_DIAGNOSTICS_MS 60000
+#endif
+#ifndef DALYBMS_TTL_REFRESH_PERCENT
+#define DALYBMS_TTL_REFRESH_PERCENT 80    // of the time to live, when refresh re-requests
+#endif
+#ifndef DALYBMS_TTL_SCAN_MS
+#define DALYBMS_TTL_SCAN_MS 1000    // between refresh scans at most, when nothing is received
+#endif
+
+struct ManagerTimesToLive {    // how long responses stay fresh, 0 for the session: per category, overridden per command
+    SystemTicks_t information { DALYBMS_TTL_INFORMATION_MS };
+    SystemTicks_t thresholds { DALYBMS_TTL_THRESHOLDS_MS };
+    SystemTicks_t conditions { DALYBMS_TTL_CONDITIONS_MS };
+    SystemTicks_t diagnostics { DALYBMS_TTL_DIAGNOSTICS_MS };
+    std::vector<std::pair<uint8_t, SystemTicks_t>> commands {};
+    bool refresh { false };    // re-request fresh responses shortly before they expire, rather than only as asked
+
+    SystemTicks_t of (const Categories category, const uint8_t command) const {
+        for (const auto &[c, ttl] : commands)
+            if (c == command)
+                return ttl;
+        switch (category) {
+        case Categories::Information:
+            return information;
+        case Categories::Thresholds:
+            return thresholds;
+        case Categories::Conditions:
+            return conditions;
+        case Categories::Diagnostics:
+            return diagnostics;
+        default:
+            return 0;
+        }
+    }
+};
+
+struct ManagerConfig {
+    String id;
+    Capabilities capabilities { Capabilities::None };
+    Categories categories { Categories::All };
+    Debugging debugging { Debugging::Errors };
+    Categories lazy { Categories::None };                         // retain frames, decode on first access
+    size_t creditRx { DALYBMS_CREDIT_RX };                        // receive buffer bytes that outstanding responses may occupy, 0 unlimited
+    SystemTicks_t requestTimeout { DALYBMS_REQUEST_TIMEOUT_MS };    // after which unanswered responses no longer hold credit
+    SystemTicks_t requestGap { 0 };                               // minimum between requests, initial pacing
+    size_t requestDepth { 0 };                                    // outstanding requests at most, 0 unlimited, initial pacing
+    ManagerTimesToLive ttl {};
+};
+
+struct ManagerStatus {
+    ActivationTracker received;
+    ActivationTracker badframes;
+    ActivationTracker held;         // requests queued for lack of credit or pacing
+    ActivationTracker timeouts;     // requests whose responses did not all arrive in time
+    ActivationTracker sent;         // requests, excluding commands
+    ActivationTracker completed;    // requests whose responses all arrived
+    ActivationTracker refreshed;    // requests issued as responses neared expiry
+    SystemTicks_t latencyTotal {}, latencyMax {};    // request to last response frame, over completed
+    SystemTicks_t startupStatus {}, startupFull {};  // from requestStartup () to first live status, and to all it planned resolved
+};
+
+// CAPABILITIES and CATEGORIES bound at compile time which responses exist at all; the Config
+// then selects amongst those at run time. Manager, with everything compiled in, is the default
 
-class Manager {
+template <Capabilities CAPABILITIES = Capabilities::All, Categories CATEGORIES = Categories::All>
+class BasicManager {
 
 public:
     using Capabilities = daly_bms::Capabilities;
     using Categories = daly_bms::Categories;
     using Debugging = daly_bms::Debugging;
 
-    struct Config {
-        String id;
-        Capabilities capabilities { Capabilities::None };
-        Categories categories { Categories::All };
-        Debugging debugging { Debugging::Errors };
-    };
+    using Config = ManagerConfig;
+    using Status = ManagerStatus;
 
-    struct Status {
-        ActivationTracker received;
-        ActivationTracker badframes;
-    };
+    template <typename TYPE>
+    using Component = RequestResponseCompiled<TYPE, CAPABILITIES, CATEGORIES>;
 
     const Config &getConfig () const {
         return config;
@@ -286,11 +651,22 @@ public:
     const Status &getStatus () const {
         return status;
     }
-    bool isEnabled (const RequestResponse *response) const {
-        auto it = std::find_if (requestResponsesSpecifications.begin (), requestResponsesSpecifications.end (), [response] (const RequestResponseSpecification &item) {
-            return &item.request == response;
+    template <typename TYPE>
+        requires std::is_base_of_v<RequestResponse, TYPE>
+    bool isEnabled (const TYPE *) const {
+        return enabledComponents & (1u << componentIndex<TYPE> ());
+    }
+    template <typename TYPE>
+    constexpr bool isEnabled (const RequestResponseDisabled<TYPE> *) const {
+        return false;
+    }
+    bool isEnabled (const RequestResponse *response) const {    // untyped, so searches: prefer the above
+        bool enabled = false;
+        visitComponents (*this, [&] (const size_t index, const RequestResponse &component) {
+            if (&component == response)
+                enabled = enabledComponents & (1u << index);
         });
-        return it != requestResponsesSpecifications.end () && (it->capabilities & config.capabilities) != Capabilities::None;
+        return enabled;
     }
     bool isEnabled (const Categories category) const {
         return (config.categories & category) != Categories::None;
@@ -300,129 +676,130 @@ public:
     };
 
     using Connector = RequestResponseFrame::Receiver;
+    using Handler = RequestResponseSubscriber::Handler;
+    using Events = RequestResponseSubscriber::Events;
 
     struct Information {    // unofficial
-        RequestResponse_BMS_CONFIG config;
-        RequestResponse_BMS_HARDWARE hardware;
-        RequestResponse_BMS_FIRMWARE firmware;
-        RequestResponse_BMS_SOFTWARE software;
-        RequestResponse_BATTERY_RATINGS battery_ratings;
-        RequestResponse_BATTERY_CODE battery_code;
-        RequestResponse_BATTERY_INFO battery_info;
-        RequestResponse_BATTERY_STAT battery_stat;
-        RequestResponse_BMS_RTC rtc;
+        [[no_unique_address]] Component<RequestResponse_BMS_CONFIG> config;
+        [[no_unique_address]] Component<RequestResponse_BMS_HARDWARE> hardware;
+        [[no_unique_address]] Component<RequestResponse_BMS_FIRMWARE> firmware;
+        [[no_unique_address]] Component<RequestResponse_BMS_SOFTWARE> software;
+        [[no_unique_address]] Component<RequestResponse_BATTERY_RATINGS> battery_ratings;
+        [[no_unique_address]] Component<RequestResponse_BATTERY_CODE> battery_code;
+        [[no_unique_address]] Component<RequestResponse_BATTERY_INFO> battery_info;
+        [[no_unique_address]] Component<RequestResponse_BATTERY_STAT> battery_stat;
+        [[no_unique_address]] Component<RequestResponse_BMS_RTC> rtc;
     } information {};
     struct Thresholds {    // unofficial
-        RequestResponse_THRESHOLDS_VOLTAGE voltage;
-        RequestResponse_THRESHOLDS_CURRENT current;
-        RequestResponse_THRESHOLDS_SENSOR sensor;
-        RequestResponse_THRESHOLDS_CHARGE charge;
-        RequestResponse_THRESHOLDS_SHORTCIRCUIT shortcircuit;
-        RequestResponse_THRESHOLDS_CELL_VOLTAGE cell_voltage;
-        RequestResponse_THRESHOLDS_CELL_SENSOR cell_sensor;
-        RequestResponse_THRESHOLDS_CELL_BALANCE cell_balance;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_VOLTAGE> voltage;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_CURRENT> current;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_SENSOR> sensor;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_CHARGE> charge;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_SHORTCIRCUIT> shortcircuit;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_CELL_VOLTAGE> cell_voltage;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_CELL_SENSOR> cell_sensor;
+        [[no_unique_address]] Component<RequestResponse_THRESHOLDS_CELL_BALANCE> cell_balance;
     } thresholds {};
     struct Conditions {
-        RequestResponse_STATUS status;
-        RequestResponse_VOLTAGE_MINMAX voltage;
-        RequestResponse_SENSOR_MINMAX sensor;
-        RequestResponse_MOSFET mosfet;
-        RequestResponse_INFORMATION information;
-        RequestResponse_FAILURE failure;
+        [[no_unique_address]] Component<RequestResponse_STATUS> status;
+        [[no_unique_address]] Component<RequestResponse_VOLTAGE_MINMAX> voltage;
+        [[no_unique_address]] Component<RequestResponse_SENSOR_MINMAX> sensor;
+        [[no_unique_address]] Component<RequestResponse_MOSFET> mosfet;
+        [[no_unique_address]] Component<RequestResponse_INFORMATION> information;
+        [[no_unique_address]] Component<RequestResponse_FAILURE> failure;
     } conditions {};
     struct Diagnostics {
-        RequestResponse_VOLTAGES voltages;
-        RequestResponse_SENSORS sensors;
-        RequestResponse_BALANCES balances;
+        [[no_unique_address]] Component<RequestResponse_VOLTAGES> voltages;
+        [[no_unique_address]] Component<RequestResponse_SENSORS> sensors;
+        [[no_unique_address]] Component<RequestResponse_BALANCES> balances;
     } diagnostics {};
     struct Commands {    // unofficial
-        RequestResponse_RESET reset;
-        RequestResponse_MOSFET_DISCHARGE discharge;
-        RequestResponse_MOSFET_CHARGE charge;
+        [[no_unique_address]] Component<RequestResponse_RESET> reset;
+        [[no_unique_address]] Component<RequestResponse_MOSFET_DISCHARGE> discharge;
+        [[no_unique_address]] Component<RequestResponse_MOSFET_CHARGE> charge;
     } commands {};
 
-    explicit Manager (const Config &conf, Connector &connector) :
-        requestResponsesSpecifications ({
-
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing,          information.config },
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing,        information.hardware },
-            { Categories::Information,                      Capabilities::FirmwareIndex,        information.firmware }, // No response, Managing or Balancing
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing,        information.software },
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing, information.battery_ratings },
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing,    information.battery_code },
-            { Categories::Information, Capabilities::Managing + Capabilities::Balancing,    information.battery_info },
-            { Categories::Information,                           Capabilities::Managing,    information.battery_stat },
-            { Categories::Information,                      Capabilities::RealTimeClock,             information.rtc },
-
-            {  Categories::Thresholds, Capabilities::Managing + Capabilities::Balancing,          thresholds.voltage },
-            {  Categories::Thresholds,                           Capabilities::Managing,          thresholds.current },
-            {  Categories::Thresholds,                 Capabilities::TemperatureSensing,           thresholds.sensor }, // Balancing response, but questionable
-            {  Categories::Thresholds,                           Capabilities::Managing,           thresholds.charge },
-            {  Categories::Thresholds, Capabilities::Managing + Capabilities::Balancing,     thresholds.cell_voltage },
-            {  Categories::Thresholds,                 Capabilities::TemperatureSensing,      thresholds.cell_sensor }, // Balancing response, but questionable
-            {  Categories::Thresholds, Capabilities::Managing + Capabilities::Balancing,     thresholds.cell_balance },
-            {  Categories::Thresholds, Capabilities::Managing + Capabilities::Balancing,     thresholds.shortcircuit },
-
-            {  Categories::Conditions,                           Capabilities::Managing,           conditions.status }, // Balancing response, but voltage only
-            {  Categories::Conditions, Capabilities::Managing + Capabilities::Balancing,          conditions.voltage },
-            {  Categories::Conditions,                 Capabilities::TemperatureSensing,           conditions.sensor }, // Balancing response, is probably onboard sensor
-            {  Categories::Conditions,                           Capabilities::Managing,           conditions.mosfet },
-            {  Categories::Conditions, Capabilities::Managing + Capabilities::Balancing,      conditions.information },
-            {  Categories::Conditions, Capabilities::Managing + Capabilities::Balancing,          conditions.failure },
-
-            { Categories::Diagnostics, Capabilities::Managing + Capabilities::Balancing,        diagnostics.voltages },
-            { Categories::Diagnostics,                 Capabilities::TemperatureSensing,         diagnostics.sensors },
-            { Categories::Diagnostics,                          Capabilities::Balancing,        diagnostics.balances },
-
-            {    Categories::Commands, Capabilities::Managing + Capabilities::Balancing,              commands.reset },
-            {    Categories::Commands,                           Capabilities::Managing,             commands.charge },
-            {    Categories::Commands,                           Capabilities::Managing,          commands.discharge }
-    }),
+    explicit BasicManager (const Config &conf, Connector &connector) :
         config (conf), connector (connector), manager (config.id, buildRequestResponses (config.capabilities)) {
 
-        struct ResponseHandler : RequestResponseManager::Handler {
-            Manager &manager;
-            bool initialised = false;
-            explicit ResponseHandler (Manager &i) :
-                manager (i) { }
-            bool handle (RequestResponse &response) override {
-                manager.status.received++;
-                if (! initialised && response.getCommand () == manager.conditions.information) {
-                    manager.diagnostics.voltages.setCount (manager.conditions.information.numberOfCells);
-                    manager.diagnostics.sensors.setCount (manager.conditions.information.numberOfSensors);
-                    manager.diagnostics.balances.setCount (manager.conditions.information.numberOfCells);
-                    initialised = true;
-                    // if (! manager.isEnabled (Debugging::Responses)) {
-                    //     manager.manager.unregisterHandler (this);
-                    //     delete this;
-                    // }
-                }
-                if (manager.isEnabled (Debugging::Responses)) {
-                    ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: response %s -- ", manager.config.id.c_str (), response.getName ());
-                    response.debugDump ();    // XXX change to toString
-                }
-                return true;
-            }
-        };
-        manager.registerHandler (new ResponseHandler (*this));
-
-        struct FrameHandler : RequestResponseFrame::Receiver::Handler {
-            Manager &manager;
-            explicit FrameHandler (Manager &i) :
-                manager (i) { }
-            bool handle (RequestResponseFrame::Receiver::Handler::Type frame) {
-                if (manager.isEnabled (Debugging::Frames) || (manager.isEnabled (Debugging::Errors) && frame.second == Direction::Error))
-                    ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: %s: %s\n", manager.config.id.c_str (), toString (frame.second).c_str (), frame.first.toString ().c_str ());
-                if (frame.second == Direction::Error)
-                    manager.status.badframes ++;
-                if (frame.second == Direction::Receive)
-                    manager.manager.receiveFrame (frame.first);
-                return frame.second == Direction::Receive;
-            }
-        };
-        connector.registerHandler (new FrameHandler (*this));
+        pacing = { config.requestGap, config.requestDepth, config.requestTimeout };
+
+        visitComponents (*this, [&] (const size_t index, auto &component) {
+            using Specification = ComponentSpecification<std::decay_t<decltype (component)>>;
+            if ((Specification::capabilities & config.capabilities) != Capabilities::None && (Specification::category & config.categories) != Categories::None && connector.carries (component.getCommand ()))
+                configuredComponents |= (1u << index);
+            if ((Specification::category & config.lazy) != Categories::None)
+                component.setDecoding (RequestResponse::Decoding::Lazy);
+            component.setTimeToLive (config.ttl.of (Specification::category, component.getCommand ()));
+        });
+        enabledComponents = configuredComponents;
+
+        if constexpr (! is_request_response_disabled<decltype (conditions.information)>::value)
+            subscribed = subscribe<&BasicManager::handleInformation> (this, conditions.information, Events::Changed);
+        if (isEnabled (Debugging::Responses))
+            subscribed = subscribe<&BasicManager::handleResponse> (this, Categories::All) && subscribed;
+        if (! connector.template registerHandler<&BasicManager::handleFrame> (this)) {
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: connector has no handler slot, nothing will be received\n", config.id.c_str ());
+            subscribed = false;
+        }
+    }
+    bool isSubscribed () const {    // false if a pool was exhausted at construction, so something is not seen
+        return subscribed;
     }
+    ~BasicManager () {
+        connector.unregisterHandler (this);
+    }
+    BasicManager (const BasicManager &) = delete;
+    BasicManager &operator= (const BasicManager &) = delete;
     friend RequestResponseFrame::Receiver::Handler;
+    // handlers are notified only for the responses they subscribe to
+    bool subscribe (Handler *handler, const Categories categories, const Events events = Events::Updated) {
+        return subscribe (RequestResponseSubscriber::Delegate (handler), categories, events);
+    }
+    bool subscribe (Handler *handler, const RequestResponse &response, const Events events = Events::Updated) {
+        return manager.registerHandler (RequestResponseSubscriber::Delegate (handler), response.getCommand (), events);
+    }
+    template <auto METHOD, typename CONTEXT>
+    bool subscribe (CONTEXT *context, const Categories categories, const Events events = Events::Updated) {
+        return subscribe (RequestResponseSubscriber::Delegate::bind<METHOD> (context), categories, events);
+    }
+    template <auto METHOD, typename CONTEXT>
+    bool subscribe (CONTEXT *context, const RequestResponse &response, const Events events = Events::Updated) {
+        return manager.registerHandler (RequestResponseSubscriber::Delegate::bind<METHOD> (context), response.getCommand (), events);
+    }
+    template <typename CONTEXT>
+    void unsubscribe (const CONTEXT *context) {    // as subscribed: the handler or the method's context
+        manager.unregisterHandler (context);
+    }
+    void notify (RequestResponse &response) {    // subscribers, as if the response had just been received
+        manager.notify (response);
+    }
+
+    // visits, in registry order, each component enabled by both the compile-time and the run-time
+    // configuration and within the given categories, as visitor (category, component)
+    template <typename VISITOR>
+    void forEachEnabledComponent (const Categories categories, VISITOR &&visitor) const {
+        forEachEnabledComponent (*this, categories, visitor);
+    }
+    template <typename VISITOR>
+    void forEachEnabledComponent (const Categories categories, VISITOR &&visitor) {
+        forEachEnabledComponent (*this, categories, visitor);
+    }
+
+    // every compiled-in component regardless of configuration, as visitor (index, category, component)
+    template <typename VISITOR>
+    void forEachComponent (VISITOR &&visitor) {
+        visitComponents (*this, [&] (const size_t index, auto &component) {
+            visitor (index, ComponentSpecification<std::decay_t<decltype (component)>>::category, component);
+        });
+    }
+    // narrows the configured components to those known to respond (bits by registry index)
+    void setResponding (const uint32_t responding) {
+        enabledComponents = configuredComponents & responding;
+    }
+    uint32_t getEnabledComponents () const {
+        return enabledComponents;
+    }
 
     void begin () {
         connector.begin ();
@@ -432,6 +809,48 @@ public:
     }
     void process () {
         connector.process ();
+        expireOutstanding ();
+        planStartup ();
+        if (config.ttl.refresh)
+            refreshExpiring ();
+        issuePending ();
+    }
+    void rescheduleRefresh () {    // after times to live were changed, so the change applies at once
+        refreshDue = systemTicksNow ();
+    }
+    bool isIdle () const {    // nothing held back nor awaiting response
+        return requestsPending.empty () && requestsOutstanding.empty ();
+    }
+    // milliseconds until process () has work other than what arrives: a request held back by the
+    // gap, an outstanding deadline, or the next refresh scan; DUE_NEVER if none, for callers that
+    // sleep between calls (e.g. PosixReactor) rather than polling
+    static constexpr SystemTicks_t DUE_NEVER = ~SystemTicks_t { 0 };
+    SystemTicks_t untilDue () const {
+        const SystemTicks_t now = systemTicksNow ();
+        SystemTicks_t until = DUE_NEVER;
+        const auto sooner = [&] (const SystemTicks_t due) {
+            until = std::min (until, static_cast<long> (due - now) > 0 ? due - now : 0);
+        };
+        if (! requestsPending.empty ())    // otherwise held for depth or credit, freed by receipt or a deadline
+            sooner (pacing.gap > 0 ? lastSent + pacing.gap : now);
+        for (const auto &outstanding : requestsOutstanding)
+            sooner (outstanding.deadline);
+        if (config.ttl.refresh)
+            sooner (refreshDue);
+        return until;
+    }
+
+    // how closely requests follow each other, seeded from the Config and refined by calibration
+    struct Pacing {
+        SystemTicks_t gap {};
+        size_t depth {};
+        SystemTicks_t timeout {};
+    };
+    const Pacing &getPacing () const {
+        return pacing;
+    }
+    void setPacing (const Pacing &p) {
+        pacing = p;
     }
 
     template <uint8_t COMMAND>
@@ -439,16 +858,30 @@ public:
         if (isEnabled (Categories::Commands) && isEnabled (&request) && request.isRequestable ()) {
             if (isEnabled (Debugging::Requests))
                 ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: command %s\n", config.id.c_str (), request.getName ());
+            transmit (request.getCommand (), expectedBytes (request));    // never held, the setting is not retained
             connector.write (request.prepareRequest (setting));
         }
     }
+    template <typename TYPE, typename SETTING>
+    void command (RequestResponseDisabled<TYPE> &, SETTING) {
+    }
 
+    // sent at once if the expected response fits within the receive credit, otherwise held in
+    // order until outstanding responses have drained; see process ()
     void issue (RequestResponse &request) {
-        if (request.isRequestable ()) {
-            if (isEnabled (Debugging::Requests))
-                ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: request %s\n", config.id.c_str (), request.getName ());
-            connector.write (request.prepareRequest ());
+        if (! request.isRequestable ())
+            return;
+        if (! requestsPending.empty () || ! canSend (expectedBytes (request))) {
+            if (std::find (requestsPending.begin (), requestsPending.end (), &request) == requestsPending.end ()) {
+                requestsPending.push_back (&request);
+                status.held++;
+            }
+            return;
         }
+        send (request);
+    }
+    template <typename TYPE>
+    void issue (RequestResponseDisabled<TYPE> &) {
     }
     void requestInstant () {
         if (isEnabled (Categories::Conditions)) {
@@ -470,6 +903,22 @@ public:
         for (auto category : { Categories::Information, Categories::Thresholds })
             request (category);
     }
+    // orders everything by how soon it is useful: live status (0x90, 0x98, 0x93) and the counts that
+    // size the diagnostics (0x94) first, then once those counts are in the cell voltages (0x95), the
+    // rest of the conditions and diagnostics, and the static Information and Thresholds last (unless
+    // initial is false, e.g. when they were restored from a cache); see getStatus () for the timings
+    void requestStartup (const bool initial = true) {
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: requestStartup\n", config.id.c_str ());
+        startupBegun = systemTicksNow ();
+        startupInitial = initial;
+        status.startupStatus = status.startupFull = 0;
+        for (const uint8_t command : { STARTUP_LIVE [0], STARTUP_LIVE [1], STARTUP_LIVE [2], STARTUP_SIZING })
+            forEachStartupComponent (Categories::Conditions, [&] (RequestResponse &component) {
+                if (component.getCommand () == command)
+                    issue (component);
+            });
+        startup = Startup::Sizing;
+    }
     void updateInitial () {
         for (auto category : { Categories::Information, Categories::Thresholds })
             update (category);
@@ -488,37 +937,276 @@ public:
         if (! isEnabled (category))
             return;
         DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: request%s\n", config.id.c_str (), toString (category).c_str ());
-        auto it = requestResponses.find (category);
-        if (it != requestResponses.end ())
-            for (auto r : it->second)
-                issue (*r);
+        forEachEnabledComponent (category, [&] (const Categories, RequestResponse &component) {
+            issue (component);
+        });
     }
     void update (const Categories category) {
         if (! isEnabled (category))
             return;
         DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: update%s\n", config.id.c_str (), toString (category).c_str ());
-        auto it = requestResponses.find (category);
-        if (it != requestResponses.end ())
-            for (auto r : it->second) {
-                if (! r->isValid ())    // XXX or long time?
-                    issue (*r);
+        forEachEnabledComponent (category, [&] (const Categories, RequestResponse &component) {
+            if (! component.isFresh ())
+                issue (component);
+        });
+    }
+
+private:
+    bool subscribe (const RequestResponseSubscriber::Delegate &delegate, const Categories categories, const Events events) {
+        if (categories == Categories::All)
+            return manager.registerHandler (delegate, events);
+        bool result = true;
+        for (const auto &[category, requests] : requestResponses)
+            if ((category & categories) != Categories::None)
+                for (const auto &request : requests)
+                    result = manager.registerHandler (delegate, request->getCommand (), events) && result;
+        return result;
+    }
+
+    bool handleInformation (RequestResponse &) {
+        const auto setCount = [] (auto &component, const size_t count) {
+            if constexpr (! is_request_response_disabled<std::decay_t<decltype (component)>>::value)
+                component.setCount (count);
+        };
+        setCount (diagnostics.voltages, conditions.information.get (&RequestResponse_INFORMATION::numberOfCells));
+        setCount (diagnostics.sensors, conditions.information.get (&RequestResponse_INFORMATION::numberOfSensors));
+        setCount (diagnostics.balances, conditions.information.get (&RequestResponse_INFORMATION::numberOfCells));
+        return true;
+    }
+    bool handleResponse (RequestResponse &response) {
+        if (response.decode ()) {
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: response %s -- ", config.id.c_str (), response.getName ());
+            response.debugDump ();    // XXX change to toString
+        }
+        return true;
+    }
+    bool handleFrame (RequestResponseFrame::Receiver::Handler::Type frame) {
+        if (isEnabled (Debugging::Frames) || (isEnabled (Debugging::Errors) && frame.second == Direction::Error))
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: %s: %s\n", config.id.c_str (), toString (frame.second).c_str (), frame.first.toString ().c_str ());
+        if (frame.second != Direction::Transmit)
+            releaseCredit (frame.second == Direction::Receive ? frame.first.getCommand () : COMMAND_UNKNOWN);
+        if (frame.second == Direction::Error)
+            status.badframes++;
+        if (frame.second == Direction::Receive && manager.receiveFrame (frame.first)) {
+            status.received++;
+            refreshDue = systemTicksNow ();    // rescan, as this may now be due before the next scan
+        }
+        return false;    // observed, not consumed: later frame handlers see it too
+    }
+
+    // receive credit: each request holds the bytes of its expected response until they arrive
+    static constexpr uint8_t COMMAND_UNKNOWN = 0xFF;
+    struct Outstanding {
+        uint8_t command;
+        size_t bytes;
+        SystemTicks_t sent, deadline;
+    };
+    static size_t expectedBytes (const RequestResponse &request) {
+        return request.getResponseFrameCount () * RequestResponseFrame::size ();
+    }
+    bool canSend (const size_t bytes) const {
+        if (pacing.gap > 0 && systemTicksNow () - lastSent < pacing.gap)
+            return false;
+        if (pacing.depth > 0 && requestsOutstanding.size () >= pacing.depth)
+            return false;
+        return config.creditRx == 0 || requestsOutstanding.empty () || outstandingBytes + bytes <= config.creditRx;
+    }
+    void send (RequestResponse &request) {
+        if (isEnabled (Debugging::Requests))
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<%s>: request %s\n", config.id.c_str (), request.getName ());
+        status.sent++;
+        transmit (request.getCommand (), expectedBytes (request));
+        connector.write (request.prepareRequest ());
+    }
+    void transmit (const uint8_t command, const size_t bytes) {    // before the write, as responses may be read inline
+        lastSent = systemTicksNow ();
+        requestsOutstanding.push_back ({ command, bytes, lastSent, lastSent + pacing.timeout });
+        outstandingBytes += bytes;
+    }
+    void releaseCredit (const uint8_t command) {    // a bad frame is charged to the oldest
+        auto it = std::find_if (requestsOutstanding.begin (), requestsOutstanding.end (), [command] (const Outstanding &outstanding) {
+            return command == COMMAND_UNKNOWN || outstanding.command == command;
+        });
+        if (it == requestsOutstanding.end ())
+            return;
+        const size_t bytes = std::min (it->bytes, RequestResponseFrame::size ());
+        outstandingBytes -= bytes;
+        if ((it->bytes -= bytes) == 0) {
+            const SystemTicks_t latency = systemTicksNow () - it->sent;
+            status.completed++;
+            status.latencyTotal += latency;
+            status.latencyMax = std::max (status.latencyMax, latency);
+            requestsOutstanding.erase (it);
+        }
+    }
+    void expireOutstanding () {
+        const SystemTicks_t now = systemTicksNow ();
+        for (auto it = requestsOutstanding.begin (); it != requestsOutstanding.end ();)
+            if (static_cast<long> (now - it->deadline) >= 0) {
+                outstandingBytes -= it->bytes;
+                it = requestsOutstanding.erase (it);
+                status.timeouts++;
+            } else
+                ++it;
+    }
+    void issuePending () {
+        while (! requestsPending.empty () && canSend (expectedBytes (*requestsPending.front ()))) {
+            RequestResponse *request = requestsPending.front ();
+            requestsPending.pop_front ();
+            send (*request);
+        }
+    }
+    // re-requests responses once valid that near expiry, scanning again when the earliest is due
+    void refreshExpiring () {
+        const SystemTicks_t now = systemTicksNow ();
+        if (static_cast<long> (now - refreshDue) < 0)
+            return;
+        refreshDue = now + DALYBMS_TTL_SCAN_MS;
+        forEachEnabledComponent (Categories::Information + Categories::Thresholds + Categories::Conditions + Categories::Diagnostics, [&] (const Categories, RequestResponse &component) {
+            const SystemTicks_t ttl = component.getTimeToLive ();
+            if (ttl == 0 || component.valid () == 0 || ! component.isRefreshed ())
+                return;
+            const SystemTicks_t due = component.valid () + ttl * DALYBMS_TTL_REFRESH_PERCENT / 100;
+            if (static_cast<long> (now - due) < 0) {
+                if (static_cast<long> (due - refreshDue) < 0)
+                    refreshDue = due;
+            } else if (! isRequested (component)) {
+                issue (component);
+                status.refreshed++;
             }
+        });
     }
+    bool isRequested (const RequestResponse &request) const {
+        if (std::find (requestsPending.begin (), requestsPending.end (), &request) != requestsPending.end ())
+            return true;
+        return std::any_of (requestsOutstanding.begin (), requestsOutstanding.end (), [&] (const Outstanding &outstanding) {
+            return outstanding.command == request.getCommand ();
+        });
+    }
+    SystemTicks_t refreshDue {};
+
+    static constexpr std::array<uint8_t, 3> STARTUP_LIVE { 0x90, 0x98, 0x93 };
+    static constexpr uint8_t STARTUP_SIZING = 0x94, STARTUP_DIAGNOSTICS = 0x95;
+    template <typename VISITOR>
+    void forEachStartupComponent (const Categories category, VISITOR &&visitor) {
+        if (isEnabled (category))
+            forEachEnabledComponent (category, [&] (const Categories, RequestResponse &component) {
+                visitor (component);
+            });
+    }
+    bool isStartupAnswered (const uint8_t command, const bool absent) {    // since requestStartup (), or absent if not enabled
+        bool answered = absent;
+        forEachStartupComponent (Categories::Conditions, [&] (RequestResponse &component) {
+            if (component.getCommand () == command)
+                answered = component.isValid () && static_cast<long> (component.valid () - startupBegun) >= 0;
+        });
+        return answered;
+    }
+    void planStartup () {
+        if (startup == Startup::Idle || startup == Startup::Started)
+            return;
+        const SystemTicks_t elapsed = systemTicksNow () - startupBegun;
+        if (status.startupStatus == 0)
+            for (const uint8_t command : STARTUP_LIVE)
+                if (isStartupAnswered (command, false)) {
+                    status.startupStatus = std::max<SystemTicks_t> (elapsed, 1);
+                    break;
+                }
+        if (startup == Startup::Sizing && (isStartupAnswered (STARTUP_SIZING, true) || isIdle ())) {
+            const auto planned = [] (const uint8_t command) {
+                return command == STARTUP_SIZING || std::find (STARTUP_LIVE.begin (), STARTUP_LIVE.end (), command) != STARTUP_LIVE.end ();
+            };
+            forEachStartupComponent (Categories::Diagnostics, [&] (RequestResponse &component) {
+                if (component.getCommand () == STARTUP_DIAGNOSTICS)
+                    issue (component);
+            });
+            forEachStartupComponent (Categories::Conditions, [&] (RequestResponse &component) {
+                if (! planned (component.getCommand ()))
+                    issue (component);
+            });
+            forEachStartupComponent (Categories::Diagnostics, [&] (RequestResponse &component) {
+                if (component.getCommand () != STARTUP_DIAGNOSTICS)
+                    issue (component);
+            });
+            if (startupInitial)
+                for (const auto category : { Categories::Information, Categories::Thresholds })
+                    forEachStartupComponent (category, [&] (RequestResponse &component) {
+                        issue (component);
+                    });
+            startup = Startup::Trickling;
+        } else if (startup == Startup::Trickling && isIdle ()) {
+            status.startupFull = std::max<SystemTicks_t> (elapsed, 1);
+            startup = Startup::Started;
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: startup status after %lums, full after %lums\n", config.id.c_str (), static_cast<unsigned long> (status.startupStatus), static_cast<unsigned long> (status.startupFull));
+        }
+    }
+    enum class Startup {
+        Idle,         // not asked for
+        Sizing,       // live status and sizing requested
+        Trickling,    // the rest requested
+        Started
+    } startup {};
+    SystemTicks_t startupBegun {};
+    bool startupInitial {};
+
+    std::deque<RequestResponse *> requestsPending;
+    std::vector<Outstanding> requestsOutstanding;
+    size_t outstandingBytes {};
+    SystemTicks_t lastSent {};
+    Pacing pacing;
 
 private:
     std::map<Categories, std::vector<RequestResponse *>> requestResponses;
-    struct RequestResponseSpecification {
-        Categories category;
-        Capabilities capabilities;
-        RequestResponse &request;
-    };
-    std::vector<RequestResponseSpecification> requestResponsesSpecifications;
+    uint32_t configuredComponents {}, enabledComponents {};
+
+    // the component registry: every response held, in traversal order, whose position is its bit
+    // in enabledComponents; compiled out components hold their position but are never visited
+    template <typename SELF>
+    static auto components (SELF &self) {
+        return std::tie (
+            self.information.config, self.information.hardware, self.information.firmware, self.information.software, self.information.battery_ratings, self.information.battery_code, self.information.battery_info, self.information.battery_stat, self.information.rtc,
+            self.thresholds.voltage, self.thresholds.current, self.thresholds.sensor, self.thresholds.charge, self.thresholds.cell_voltage, self.thresholds.cell_sensor, self.thresholds.cell_balance, self.thresholds.shortcircuit,
+            self.conditions.status, self.conditions.voltage, self.conditions.sensor, self.conditions.mosfet, self.conditions.information, self.conditions.failure,
+            self.diagnostics.voltages, self.diagnostics.sensors, self.diagnostics.balances,
+            self.commands.reset, self.commands.charge, self.commands.discharge);
+    }
+    template <typename TYPE, size_t INDEX = 0>
+    static constexpr size_t componentIndex () {
+        using Components = decltype (components (std::declval<BasicManager &> ()));
+        static_assert (std::tuple_size_v<Components> <= 32, "enabledComponents too narrow");
+        if constexpr (std::is_same_v<std::tuple_element_t<INDEX, Components>, TYPE &>)
+            return INDEX;
+        else
+            return componentIndex<TYPE, INDEX + 1> ();
+    }
+    template <typename SELF, typename VISITOR>
+    static void visitComponents (SELF &self, VISITOR &&visitor) {
+        const auto visit = [&] (const size_t index, auto &component) {
+            if constexpr (! is_request_response_disabled<std::decay_t<decltype (component)>>::value)
+                visitor (index, component);
+        };
+        std::apply ([&] (auto &...component) {
+            size_t index = 0;
+            (visit (index++, component), ...);
+        },
+                    components (self));
+    }
+    template <typename SELF, typename VISITOR>
+    static void forEachEnabledComponent (SELF &self, const Categories categories, VISITOR &visitor) {
+        visitComponents (self, [&] (const size_t index, auto &component) {
+            constexpr Categories category = ComponentSpecification<std::decay_t<decltype (component)>>::category;
+            if ((category & categories) != Categories::None && (self.enabledComponents & (1u << index)))
+                visitor (category, component);
+        });
+    }
 
     std::vector<RequestResponse *> buildRequestResponses (const Capabilities capabilities) {
         std::vector<RequestResponse *> r;
-        for (const auto &item : requestResponsesSpecifications)
-            if ((item.capabilities & capabilities) != Capabilities::None)
-                requestResponses [item.category].push_back (&item.request);
+        visitComponents (*this, [&] (const size_t, auto &component) {
+            using Specification = ComponentSpecification<std::decay_t<decltype (component)>>;
+            if ((Specification::capabilities & capabilities) != Capabilities::None)
+                requestResponses [Specification::category].push_back (&component);
+        });
         for (const auto &[category, requests] : requestResponses)
             r.insert (r.end (), requests.begin (), requests.end ());
         return r;
@@ -526,10 +1214,14 @@ private:
 
     const Config &config;
     Status status;
+    bool subscribed { true };
     Connector &connector;
-    RequestResponseManager manager;
+    using Components = decltype (components (std::declval<BasicManager &> ()));
+    RequestResponseManager<countRequestResponsesCompiled<Components> (std::make_index_sequence<std::tuple_size_v<Components>> ())> manager;
 };
 
+using Manager = BasicManager<>;
+
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
 
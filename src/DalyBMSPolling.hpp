@@ -0,0 +1,190 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// adapts how often each response is refreshed to how much the pack is doing: an activity level
+// from 0 (stationary, no current, cells steady) to 1 (charging or discharging hard, or cells moving
+// fast) places each command's period between its slowest and fastest, geometrically. The period
+// is applied as the response's time to live, so the manager's refresh (ManagerTimesToLive::refresh,
+// which must be enabled) is what polls; bus usage and update intervals are accounted per ChargeState for reporting
+
+template <typename MANAGER>
+class AdaptivePolling {
+public:
+    struct Period {
+        uint8_t command;
+        SystemTicks_t fastest, slowest;
+    };
+    struct Config {
+        std::vector<Period> periods {
+            { 0x90, 1000, 10000 },     // status
+            { 0x93, 2000, 30000 },     // mosfet
+            { 0x98, 2000, 30000 },     // failures
+            { 0x95, 2000, 60000 },     // voltages
+            { 0x96, 5000, 120000 },    // sensors
+        };
+        float currentIdle { 0.5f }, currentActive { 5.0f };    // amps, |current| from none to fully active
+        float slopeActive { 0.010f };                           // volts per minute of the fastest moving cell, fully active
+        unsigned long baud { 9600 };                            // to express bytes as bus utilisation
+    };
+    struct Regime {    // accounting while in one ChargeState
+        SystemTicks_t duration {};
+        counter_t bytes {}, status {}, voltages {};
+        float utilisation (const unsigned long baud) const {    // of the bus, 10 bits per byte
+            return duration > 0 ? (bytes * 10 * 1000.0f) / (static_cast<float> (baud) * duration) : 0.0f;
+        }
+        SystemTicks_t statusInterval () const {    // mean between status updates, i.e. resolution achieved
+            return status > 0 ? duration / status : 0;
+        }
+        SystemTicks_t voltagesInterval () const {
+            return voltages > 0 ? duration / voltages : 0;
+        }
+    };
+
+    AdaptivePolling (MANAGER &manager, RequestResponseFrame::Receiver &connector, const Config &config = Config ()) :
+        _manager (manager),
+        _connector (connector),
+        _config (config) {
+        for (const auto &period : _config.periods)
+            _manager.forEachComponent ([&] (const size_t, const Categories, auto &component) {
+                if (component.getCommand () == period.command)
+                    _polled.push_back ({ &static_cast<RequestResponse &> (component), period });
+            });
+        _subscribed = _manager.template subscribe<&AdaptivePolling::handleResponse> (this, Categories::Conditions + Categories::Diagnostics);
+        _subscribed = _connector.template registerHandler<&AdaptivePolling::handleFrame> (this) && _subscribed;
+        if (! _manager.getConfig ().ttl.refresh)
+            ALWAYS_DEBUG_PRINTF ("AdaptivePolling<%s>: manager refresh is disabled, nothing will be polled\n", _manager.getConfig ().id.c_str ());
+        _accounted = systemTicksNow ();
+        apply (1.0f);    // until there is evidence of idleness
+    }
+    ~AdaptivePolling () {
+        _connector.unregisterHandler (this);
+        _manager.unsubscribe (this);
+    }
+    AdaptivePolling (const AdaptivePolling &) = delete;
+    AdaptivePolling &operator= (const AdaptivePolling &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    float activity () const {
+        return _activity;
+    }
+    ChargeState state () const {
+        return _state;
+    }
+    SystemTicks_t period (const uint8_t command) const {
+        for (const auto &polled : _polled)
+            if (polled.response->getCommand () == command)
+                return polled.current;
+        return 0;
+    }
+    const Regime &regime (const ChargeState state) {
+        account ();
+        return _regimes [static_cast<size_t> (state) % _regimes.size ()];
+    }
+    unsigned long baud () const {
+        return _config.baud;
+    }
+
+private:
+    struct Polled {
+        RequestResponse *response;
+        Period bounds;
+        SystemTicks_t current {};
+    };
+
+    void account () {
+        const SystemTicks_t now = systemTicksNow ();
+        _regimes [static_cast<size_t> (_state) % _regimes.size ()].duration += now - _accounted;
+        _accounted = now;
+    }
+    bool handleFrame (RequestResponseFrame::Receiver::Handler::Type frame) {
+        if (frame.second != Direction::Error)
+            _regimes [static_cast<size_t> (_state) % _regimes.size ()].bytes += RequestResponseFrame::Constants::SIZE_FRAME;
+        return false;
+    }
+    bool handleResponse (RequestResponse &response) {
+        account ();
+        Regime &regime = _regimes [static_cast<size_t> (_state) % _regimes.size ()];
+        switch (response.getCommand ()) {
+        case 0x90 :
+            _current = std::fabs (response.get (&RequestResponse_STATUS::current));
+            regime.status++;
+            break;
+        case 0x93 :
+            _state = response.get (&RequestResponse_MOSFET::state);
+            break;
+        case 0x95 :
+            slope (response.get (&RequestResponse_VOLTAGES::values));
+            regime.voltages++;
+            break;
+        default :
+            return false;
+        }
+        apply (measure ());
+        return false;
+    }
+    void slope (const std::vector<float> &voltages) {
+        const SystemTicks_t now = systemTicksNow ();
+        if (voltages.size () == _voltages.size () && now > _voltagesTime) {
+            float moved = 0.0f;
+            for (size_t i = 0; i < voltages.size (); i++)
+                moved = std::max (moved, std::fabs (voltages [i] - _voltages [i]));
+            _slope = moved * 60000.0f / static_cast<float> (now - _voltagesTime);
+        }
+        _voltages = voltages;
+        _voltagesTime = now;
+    }
+    float measure () const {
+        const auto unit = [] (const float value) {
+            return std::min (1.0f, std::max (0.0f, value));
+        };
+        const float byState = _state == ChargeState::Stationary ? 0.0f : 0.5f;
+        const float byCurrent = unit ((_current - _config.currentIdle) / (_config.currentActive - _config.currentIdle));
+        const float bySlope = _config.slopeActive > 0.0f ? unit (_slope / _config.slopeActive) : 0.0f;
+        return std::max (byState, std::max (byCurrent, bySlope));
+    }
+    void apply (const float activity) {
+        _activity = activity;
+        for (auto &polled : _polled) {
+            const float ratio = static_cast<float> (polled.bounds.fastest) / static_cast<float> (polled.bounds.slowest);
+            polled.current = static_cast<SystemTicks_t> (polled.bounds.slowest * std::pow (ratio, activity));
+            polled.response->setTimeToLive (polled.current * 100 / DALYBMS_TTL_REFRESH_PERCENT);    // refreshed at the period, unless overridden
+        }
+        _manager.rescheduleRefresh ();
+    }
+
+    MANAGER &_manager;
+    RequestResponseFrame::Receiver &_connector;
+    const Config _config;
+    std::vector<Polled> _polled {};
+    std::array<Regime, 3> _regimes {};    // by ChargeState
+    SystemTicks_t _accounted {};
+    ChargeState _state { ChargeState::Stationary };
+    float _current {}, _slope {}, _activity {};
+    std::vector<float> _voltages {};
+    SystemTicks_t _voltagesTime {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
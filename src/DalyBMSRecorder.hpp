@@ -0,0 +1,205 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <array>
+#include <bitset>
+#include <cstring>
+#include <vector>
+
+#ifndef DALYBMS_RECORDER_FRAMES
+#define DALYBMS_RECORDER_FRAMES 512    // ring capacity, ~20 bytes each
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// keeps the last frames of every condition and diagnostic response in a fixed ring, at a fixed
+// cost per frame. A newly set failure bit, or trigger (), raises the refresh of status, voltage
+// and temperature extremes, cell voltages and temperatures to the boost period, records for the
+// post-trigger time, then freezes the window (the pre-trigger time before and everything after)
+// and restores the refresh (which the manager's ManagerTimesToLive::refresh must enable for the
+// boost to have effect); exportCapture () writes the frozen window, rearm () starts again.
+// Post-trigger frames never overwrite pre-trigger ones: if the ring is short, capture ends early
+
+template <typename MANAGER, size_t CAPACITY = DALYBMS_RECORDER_FRAMES>
+class FlightRecorder {
+public:
+    struct Config {
+        SystemTicks_t pre { 30000 }, post { 10000 };    // window either side of the trigger
+        SystemTicks_t boost { 250 };                     // refresh period of the boosted commands after the trigger
+        std::vector<uint8_t> boosted { 0x90, 0x91, 0x95, 0x96 };
+    };
+    enum class State : uint8_t {
+        Recording,
+        Capturing,    // triggered, recording the post-trigger time at the boost period
+        Frozen
+    };
+    enum class Trigger : uint8_t {
+        None,
+        Failure,
+        User
+    };
+
+    FlightRecorder (MANAGER &manager, RequestResponseFrame::Receiver &connector, const Config &config = Config ()) :
+        _manager (manager),
+        _connector (connector),
+        _config (config) {
+        _manager.forEachComponent ([&] (const size_t, const Categories category, auto &component) {
+            if ((category & (Categories::Conditions + Categories::Diagnostics)) != Categories::None)
+                _recorded.set (component.getCommand ());
+            for (const auto command : _config.boosted)
+                if (component.getCommand () == command)
+                    _boosted.push_back (&static_cast<RequestResponse &> (component));
+        });
+        if constexpr (! is_request_response_disabled<decltype (_manager.conditions.failure)>::value)
+            _subscribed = _manager.template subscribe<&FlightRecorder::handleFailure> (this, _manager.conditions.failure);
+        _subscribed = _connector.template registerHandler<&FlightRecorder::handleFrame> (this) && _subscribed;
+    }
+    ~FlightRecorder () {
+        if (_state == State::Capturing)
+            boost (false);
+        _connector.unregisterHandler (this);
+        _manager.unsubscribe (this);
+    }
+    FlightRecorder (const FlightRecorder &) = delete;
+    FlightRecorder &operator= (const FlightRecorder &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    bool trigger (const Trigger reason = Trigger::User) {
+        if (_state != State::Recording)
+            return false;
+        _reason = reason;
+        _triggered = systemTicksNow ();
+        _protected = 0;    // records within the pre-trigger window, oldest first from _head - _count
+        for (size_t i = 0; i < _count; i++)
+            if (static_cast<long> (at (i).time - (_triggered - _config.pre)) >= 0) {
+                _protected = _count - i;
+                break;
+            }
+        _post = 0;
+        _state = State::Capturing;
+        boost (true);
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: recorder triggered (%s), %u frames before\n", _manager.getConfig ().id.c_str (), reason == Trigger::Failure ? "failure" : "user", static_cast<unsigned> (_protected));
+        return true;
+    }
+    void process () {
+        if (_state == State::Capturing && static_cast<long> (systemTicksNow () - _triggered) >= static_cast<long> (_config.post))
+            freeze ();
+    }
+    void rearm () {
+        if (_state == State::Capturing)
+            boost (false);
+        _state = State::Recording;
+        _reason = Trigger::None;
+    }
+
+    State state () const {
+        return _state;
+    }
+    Trigger reason () const {
+        return _reason;
+    }
+    size_t frames () const {    // in the frozen window
+        return _state == State::Frozen ? _protected + _post : 0;
+    }
+    // frozen window as: "DBFR", version, reason, frame count (u16), then per frame: milliseconds
+    // relative to the trigger (i32) and the 13 frame bytes; integers little endian. WRITER is
+    // called as write (const uint8_t *, size_t), returns bytes written in total, 0 unless frozen
+    template <typename WRITER>
+    size_t exportCapture (WRITER &&write) const {
+        if (_state != State::Frozen)
+            return 0;
+        const size_t count = frames ();
+        const uint8_t header [8] = { 'D', 'B', 'F', 'R', VERSION, static_cast<uint8_t> (_reason), static_cast<uint8_t> (count), static_cast<uint8_t> (count >> 8) };
+        size_t written = 0;
+        write (header, sizeof (header));
+        written += sizeof (header);
+        for (size_t i = _count - count; i < _count; i++) {
+            const Record &record = at (i);
+            const uint32_t offset = static_cast<uint32_t> (static_cast<int32_t> (record.time - _triggered));
+            uint8_t bytes [4 + RequestResponseFrame::Constants::SIZE_FRAME];
+            for (size_t b = 0; b < 4; b++)
+                bytes [b] = static_cast<uint8_t> (offset >> (8 * b));
+            std::memcpy (&bytes [4], record.frame.data (), RequestResponseFrame::Constants::SIZE_FRAME);
+            write (bytes, sizeof (bytes));
+            written += sizeof (bytes);
+        }
+        return written;
+    }
+
+private:
+    static constexpr uint8_t VERSION = 1;
+    struct Record {
+        SystemTicks_t time;
+        RequestResponseFrame frame;
+    };
+
+    const Record &at (const size_t index) const {    // 0 is the oldest held
+        return _ring [(_head + CAPACITY - _count + index) % CAPACITY];
+    }
+    bool handleFrame (RequestResponseFrame::Receiver::Handler::Type frame) {
+        if (frame.second != Direction::Receive || _state == State::Frozen || ! _recorded.test (frame.first.getCommand ()))
+            return false;
+        if (_state == State::Capturing && _protected + _post == CAPACITY) {    // would overwrite the pre-trigger window
+            freeze ();
+            return false;
+        }
+        _ring [_head] = { systemTicksNow (), frame.first };
+        _head = (_head + 1) % CAPACITY;
+        _count = std::min (_count + 1, CAPACITY);
+        if (_state == State::Capturing)
+            _post++;
+        return false;
+    }
+    bool handleFailure (RequestResponse &response) {
+        const auto &active = response.get (&RequestResponse_FAILURE::active);
+        const bool raised = (active & ~_failures).any ();
+        _failures = active;
+        if (raised)
+            trigger (Trigger::Failure);
+        return false;
+    }
+    void boost (const bool boosting) {
+        for (auto &response : _boosted)    // over whatever time to live is set meanwhile, e.g. by polling
+            if (boosting)
+                response->setTimeToLiveOverride (_config.boost * 100 / DALYBMS_TTL_REFRESH_PERCENT);
+            else
+                response->clearTimeToLiveOverride ();
+        _manager.rescheduleRefresh ();
+    }
+    void freeze () {
+        boost (false);
+        _state = State::Frozen;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: recorder frozen, %u frames before and %u after\n", _manager.getConfig ().id.c_str (), static_cast<unsigned> (_protected), static_cast<unsigned> (_post));
+    }
+
+    MANAGER &_manager;
+    RequestResponseFrame::Receiver &_connector;
+    const Config _config;
+    std::bitset<256> _recorded {};
+    std::vector<RequestResponse *> _boosted {};
+    std::array<Record, CAPACITY> _ring {};
+    size_t _head {}, _count {}, _protected {}, _post {};
+    State _state { State::Recording };
+    Trigger _reason { Trigger::None };
+    SystemTicks_t _triggered {};
+    std::decay_t<decltype (RequestResponse_FAILURE::active)> _failures {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
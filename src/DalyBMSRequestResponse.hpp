@@ -8,6 +8,8 @@
 
 #include <cstdint>
 #include <array>
+#include <cassert>
+#include <thread>
 
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
@@ -92,6 +94,18 @@ public:
         _data [Constants::SIZE_HEADER + offset] = value;
         return *this;
     }
+    inline RequestResponseFrame &setUInt16 (const size_t offset, const uint16_t value) {
+        validateDataOffset (offset + 1);
+        _data [Constants::SIZE_HEADER + offset] = static_cast<uint8_t> (value >> 8);
+        _data [Constants::SIZE_HEADER + offset + 1] = static_cast<uint8_t> (value);
+        return *this;
+    }
+    inline RequestResponseFrame &setUInt32 (const size_t offset, const uint32_t value) {
+        validateDataOffset (offset + 3);
+        for (size_t i = 0; i < 4; i++)
+            _data [Constants::SIZE_HEADER + offset + i] = static_cast<uint8_t> (value >> (24 - i * 8));
+        return *this;
+    }
 
     //
 
@@ -105,6 +119,11 @@ public:
     String toString () const {
         return BytesToHexString<Constants::SIZE_FRAME> (_data.data (), " ");
     }
+    uint32_t hash (uint32_t value = 2166136261u) const {    // FNV-1a over the content, chainable across frames
+        for (size_t i = 0; i < Constants::SIZE_DATA; i++)
+            value = (value ^ _data [Constants::SIZE_HEADER + i]) * 16777619u;
+        return value;
+    }
 
 protected:
     friend Receiver;
@@ -173,6 +192,11 @@ class RequestResponse {
 public:
     using Builder = RequestResponse_Builder;
 
+    enum class Decoding {
+        Eager,    // decode into fields as each frame arrives
+        Lazy      // retain frames, decode into fields on first access after a change
+    };
+
     RequestResponse (RequestResponse_Builder &builder) :
         _request (builder.getRequest ()),
         _responsesExpected (builder.getResponseCount ()) { }
@@ -192,17 +216,92 @@ public:
     bool isComplete () const {
         return (_responsesReceived == _responsesExpected);
     }
+    size_t getResponseFrameCount () const {
+        return _responsesExpected;
+    }
     virtual RequestResponseFrame prepareRequest () {
         _responsesReceived = 0;
         return _request;
     }
+    bool isChanged () const {
+        return _changed;
+    }
+    // fresh: valid and received within the time to live (0, the default, for the whole session)
+    void setTimeToLive (const SystemTicks_t ttl) {
+        _timeToLive = ttl;
+    }
+    SystemTicks_t getTimeToLive () const {    // as in effect, the override if set
+        return _timeToLiveOverridden ? _timeToLiveOverride : _timeToLive;
+    }
+    // takes precedence over the time to live until cleared, e.g. to refresh faster for a while, so
+    // the time to live can still be set underneath (as by adaptive polling) and applies once cleared
+    void setTimeToLiveOverride (const SystemTicks_t ttl) {
+        _timeToLiveOverride = ttl;
+        _timeToLiveOverridden = true;
+    }
+    void clearTimeToLiveOverride () {
+        _timeToLiveOverridden = false;
+    }
+    bool isTimeToLiveOverridden () const {
+        return _timeToLiveOverridden;
+    }
+    SystemTicks_t age () const {    // since receipt, 0 if not valid
+        return _validState ? systemTicksNow () - _validTime : 0;
+    }
+    bool isFresh () const {
+        const SystemTicks_t ttl = getTimeToLive ();
+        return _validState && (ttl == 0 || age () < ttl);
+    }
+    // refreshed: re-requested by the manager as it nears expiry, if the manager refreshes at all
+    // (see ManagerTimesToLive::refresh); cleared by whoever takes over requesting it
+    void setRefreshed (const bool refreshed) {
+        _refreshed = refreshed;
+    }
+    bool isRefreshed () const {
+        return _refreshed;
+    }
+    void invalidate () {    // content known not to apply any more, e.g. restored from another device
+        _validState = false;
+        _responsesReceived = 0;
+    }
     bool processResponse (const RequestResponseFrame &frame) {
         _validState = false;
-        if (++_responsesReceived <= _responsesExpected && (_responsesExpected == 1 || frame.getUInt8 (0) == _responsesReceived))
-            return processResponseFrame (frame, _responsesReceived);
-        else
+        if (++_responsesReceived <= _responsesExpected && (_responsesExpected == 1 || frame.getUInt8 (0) == _responsesReceived)) {
+            _hashReceived = _responsesReceived == 1 ? frame.hash () : frame.hash (_hashReceived);
+            const bool processed = _decoding == Decoding::Lazy ? retainResponseFrame (frame, _responsesReceived) : processResponseFrame (frame, _responsesReceived);
+            if (_validState) {
+                _changed = _hashReceived != _hashValid;
+                _hashValid = _hashReceived;
+            }
+            return processed;
+        } else
             return false;
     }
+    void setDecoding (const Decoding decoding) {    // eager regardless, if the type holds no frames
+        _decoding = retainedFramesMax () > 0 ? decoding : Decoding::Eager;
+        _decodePending = false;
+    }
+    Decoding getDecoding () const {
+        return _decoding;
+    }
+    // as isValid (), but also brings fields up to date with the retained frames if lazy. Like the
+    // fields themselves, only for the thread that dispatches responses (the one calling the manager's
+    // process (), never a worker draining a connector), so a const reader decoding is not a race;
+    // asserted against the thread that retained the frames
+    bool decode () const {
+        if (_decodePending && _validState) {
+#ifndef NDEBUG
+            assert (_retainedBy == std::this_thread::get_id ());
+#endif
+            const_cast<RequestResponse *> (this)->decodeResponseFrames ();
+        }
+        return _validState;
+    }
+    template <typename SELF, typename TYPE>
+    const TYPE &get (TYPE SELF::*member) const {
+        decode ();
+        return static_cast<const SELF *> (this)->*member;
+    }
     virtual const char *getName () const = 0;
     virtual void debugDump () const = 0;
 
@@ -216,15 +315,59 @@ protected:
     virtual bool processResponseFrame (const RequestResponseFrame &frame, const size_t number) {
         return setValid ();
     }
+    // whatever could make processResponseFrame () refuse the frame, checked without decoding, so that
+    // lazily retained frames are published as valid only when their later decode cannot fail
+    virtual bool checkResponseFrame (const RequestResponseFrame &, const size_t) const {
+        return true;
+    }
     void setResponseFrameCount (const size_t count) {
+        assert (count <= retainedFramesMax ());
         _responsesExpected = count;
     }
+    // inline storage for the frames retained when lazy, at the most the type can expect, so that
+    // retaining never allocates; none here, so only eager
+    virtual RequestResponseFrame *retainedFrames () {
+        return nullptr;
+    }
+    virtual size_t retainedFramesMax () const {
+        return 0;
+    }
 
 private:
-    bool _validState {};
-    SystemTicks_t _validTime {};
+    bool retainResponseFrame (const RequestResponseFrame &frame, const size_t number) {
+        if (! checkResponseFrame (frame, number))
+            return setValid (false);
+        retainedFrames () [number - 1] = frame;
+#ifndef NDEBUG
+        _retainedBy = std::this_thread::get_id ();
+#endif
+        if (number < _responsesExpected)
+            return true;
+        _decodePending = true;
+        return setValid ();
+    }
+    void decodeResponseFrames () {
+        const SystemTicks_t validTime = _validTime;
+        bool decoded = true;
+        const RequestResponseFrame *frames = retainedFrames ();
+        for (size_t number = 1; number <= _responsesExpected && decoded; number++)
+            decoded = processResponseFrame (frames [number - 1], number);
+        _validState = decoded;
+        _validTime = validTime;    // time of receipt, not of decode
+        _decodePending = false;
+    }
+
+    bool _validState {}, _changed {}, _refreshed { true };
+    SystemTicks_t _validTime {}, _timeToLive {}, _timeToLiveOverride {};
+    bool _timeToLiveOverridden {};
+    uint32_t _hashReceived {}, _hashValid {};
     RequestResponseFrame _request {};
     size_t _responsesExpected {}, _responsesReceived {};
+    Decoding _decoding { Decoding::Eager };
+    bool _decodePending {};
+#ifndef NDEBUG
+    std::thread::id _retainedBy {};
+#endif
 };
 
 // -----------------------------------------------------------------------------------------------
@@ -156,7 +156,9 @@ public:
 
 // -----------------------------------------------------------------------------------------------
 
-template <uint8_t COMMAND>
+// FRAMES: the most response frames the type can expect, held inline for lazy decoding
+
+template <uint8_t COMMAND, size_t FRAMES = 1>
 class RequestResponseCommand : public RequestResponse {
 public:
     RequestResponseCommand () :
@@ -173,25 +175,40 @@ protected:
     using RequestResponse::isValid;
     using RequestResponse::setValid;
     using RequestResponse::setResponseFrameCount;
+    RequestResponseFrame *retainedFrames () override {
+        return _retained;
+    }
+    size_t retainedFramesMax () const override {
+        return FRAMES;
+    }
+
+private:
+    RequestResponseFrame _retained [FRAMES];
 };
 
-template <uint8_t COMMAND>
-bool operator== (const RequestResponseCommand<COMMAND> &lhs, const uint8_t rhs) {
+template <uint8_t COMMAND, size_t FRAMES>
+bool operator== (const RequestResponseCommand<COMMAND, FRAMES> &lhs, const uint8_t rhs) {
     return rhs == COMMAND;
 }
-template <uint8_t COMMAND>
-bool operator== (const uint8_t rhs, const RequestResponseCommand<COMMAND> &lhs) {
+template <uint8_t COMMAND, size_t FRAMES>
+bool operator== (const uint8_t rhs, const RequestResponseCommand<COMMAND, FRAMES> &lhs) {
     return rhs == COMMAND;
 }
 
 // -----------------------------------------------------------------------------------------------
 
+namespace detail {
+inline constexpr size_t STRING_LENGTH_MAX = 8;    // frames
+}
+
 template <uint8_t COMMAND, int LENGTH = 1>
-class RequestResponse_TYPE_STRING : public RequestResponseCommand<COMMAND> {
+class RequestResponse_TYPE_STRING : public RequestResponseCommand<COMMAND, detail::STRING_LENGTH_MAX> {
+    using Base = RequestResponseCommand<COMMAND, detail::STRING_LENGTH_MAX>;
+
 public:
     String string;
     RequestResponse_TYPE_STRING () :
-        RequestResponseCommand<COMMAND> () {
+        Base () {
         setResponseFrameCount (LENGTH);
     }
     static constexpr const char *getTypeName () {
@@ -205,17 +222,25 @@ public:
             return;
         ALWAYS_DEBUG_PRINTF ("%s\n", string.c_str ());
     }
-    using RequestResponseCommand<COMMAND>::isValid;
+    bool setLength (const size_t frames) {    // for devices answering with other than LENGTH frames
+        if (frames == 0 || frames > LENGTH_MAX)
+            return false;
+        setResponseFrameCount (frames);
+        return true;
+    }
+    using Base::isValid;
+    using Base::getResponseFrameCount;
 
 protected:
-    using RequestResponseCommand<COMMAND>::setValid;
-    using RequestResponseCommand<COMMAND>::setResponseFrameCount;
+    static constexpr size_t LENGTH_MAX = detail::STRING_LENGTH_MAX;
+    using Base::setValid;
+    using Base::setResponseFrameCount;
     bool processResponseFrame (const RequestResponseFrame &frame, const size_t frameNum) override {
         if (frameNum == 1)
             string = "";
         for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA - 1; i++)
             string += static_cast<char> (frame.getUInt8 (1 + i));
-        if (frameNum == LENGTH) {
+        if (frameNum == getResponseFrameCount ()) {
             string.trim ();
             return setValid ();
         }
@@ -590,7 +615,7 @@ public:
         return "RequestResponse_STATUS";
     }
     String toString () const {
-        return isValid () ? String (voltage, 1) + "V, " + String (current, 1) + "A, " + String (charge, 0) + "%" : "";
+        return decode () ? String (voltage, 1) + "V, " + String (current, 1) + "A, " + String (charge, 0) + "%" : "";
     }
     void debugDump () const override {
         if (! isValid ())
@@ -739,7 +764,9 @@ protected:
 // -----------------------------------------------------------------------------------------------
 
 template <uint8_t COMMAND, typename TYPE, int SIZE, size_t ITEMS_MAX, size_t ITEMS_PER_FRAME, bool FRAMENUM, auto DECODER>
-class RequestResponse_TYPE_ARRAY : public RequestResponseCommand<COMMAND> {
+class RequestResponse_TYPE_ARRAY : public RequestResponseCommand<COMMAND, (ITEMS_MAX / ITEMS_PER_FRAME) + 1> {
+    using Base = RequestResponseCommand<COMMAND, (ITEMS_MAX / ITEMS_PER_FRAME) + 1>;
+
 public:
     std::vector<TYPE> values {};
     bool setCount (const size_t count) {
@@ -767,13 +794,16 @@ public:
             ALWAYS_DEBUG_PRINTF (" %s", detail::toString (v).c_str ());    // XXX units
         ALWAYS_DEBUG_PRINTF ("\n");
     }
-    using RequestResponseCommand<COMMAND>::isValid;
+    using Base::isValid;
 
 protected:
-    using RequestResponseCommand<COMMAND>::setValid;
-    using RequestResponseCommand<COMMAND>::setResponseFrameCount;
+    using Base::setValid;
+    using Base::setResponseFrameCount;
+    bool checkResponseFrame (const RequestResponseFrame &frame, const size_t frameNum) const override {
+        return ! FRAMENUM || (frame.getUInt8 (0) == frameNum && frame.getUInt8 (0) <= (values.size () / ITEMS_PER_FRAME) + 1);
+    }
     bool processResponseFrame (const RequestResponseFrame &frame, const size_t frameNum) override {
-        if (FRAMENUM && (frame.getUInt8 (0) != frameNum || frame.getUInt8 (0) > (values.size () / ITEMS_PER_FRAME) + 1))
+        if (! checkResponseFrame (frame, frameNum))
             return false;
         for (size_t i = 0; i < ITEMS_PER_FRAME && (((frameNum - 1) * ITEMS_PER_FRAME) + i) < values.size (); i++)
             if (! DECODER (frame, (FRAMENUM ? 1 : 0) + i * SIZE, &values [((frameNum - 1) * ITEMS_PER_FRAME) + i]))
@@ -818,6 +848,12 @@ public:
     bool show {};
     std::bitset<NUM_FAILURE_CODES> active {};
     size_t count {};
+    uint64_t word {};                  // active, as bits by code
+    uint64_t raised {}, cleared {};    // against the previous response decoded, so no change costs nothing to find
+    static constexpr size_t CODES = NUM_FAILURE_CODES;
+    static const char *getFailureDescription (const size_t code) {
+        return code < NUM_FAILURE_CODES ? FAILURE_DESCRIPTIONS [code] : "";
+    }
     size_t getFailureList (const char **output, const size_t maxFailures) const {
         size_t c = 0;
         for (size_t i = 0; i < NUM_FAILURE_CODES && c < maxFailures; ++i)
@@ -830,7 +866,7 @@ public:
     }
     String toString () const {
         String r;
-        if (isValid () && count > 0) {
+        if (decode () && count > 0) {
             const char *failures [count];
             for (size_t i = 0, c = getFailureList (failures, count); i < c; i++)
                 r += (r.isEmpty () ? "" : ", ") + String (failures [i]);
@@ -849,10 +885,16 @@ public:
 
 protected:
     bool processResponseFrame (const RequestResponseFrame &frame, const size_t) override {
-        count = 0;
-        for (size_t index = 0; index < NUM_FAILURE_CODES; ++index)
-            if ((active [index] = frame.getBit (index)))
-                count++;
+        uint64_t bits = 0;
+        for (size_t byte = 0; byte < NUM_FAILURE_BYTES; ++byte)
+            bits |= static_cast<uint64_t> (frame.getUInt8 (byte)) << (byte * 8);
+        raised = bits & ~word;
+        cleared = word & ~bits;
+        if (bits != word) {
+            word = bits;
+            active = std::bitset<NUM_FAILURE_CODES> (bits);
+            count = active.count ();
+        }
         show = frame.getUInt8 (7) == 0x03;
         return setValid ();
     }
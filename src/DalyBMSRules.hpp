@@ -0,0 +1,524 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef DALYBMS_RULES_DEPTH
+#define DALYBMS_RULES_DEPTH 16    // evaluation stack, bounding how deeply a rule may nest
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct RuleEvent {
+    size_t rule;
+    const char *name;
+    bool active;
+};
+
+// user alarm rules, as text compiled once into postfix code over a fixed set of fields, e.g.
+//
+//     cell delta > 30 mV for 60 s while charging
+//     sensor max > 45 °C and current > 50 A
+//
+// grammar: rule := expression { "for" number ("ms" | "s" | "min" | "h") | "while" expression }
+//          expression := or-and-not ("or" "||" "and" "&&" "not" "!") of comparisons (< <= > >= == !=)
+//          of arithmetic (+ - * / unary -) of numbers with an optional unit (mV V A °C C % Ah), fields
+//          (see FIELDS, words joined by spaces or underscores) and parentheses
+//
+// "while" is a conjunction; "for" holds the whole rule true for that long before it becomes
+// active. Field values are refreshed when their response changes, and only the rules that read
+// one of those fields are run again; running a rule uses a fixed stack and allocates nothing.
+// A rule reading any field that is invalid or compiled out does not hold
+
+template <typename MANAGER>
+class RuleEngine : public Handlerable<const RuleEvent &> {
+public:
+    struct Field {
+        const char *name;
+        uint8_t command;
+        float (*read) (const MANAGER &);
+    };
+
+private:
+    template <typename COMPONENT, typename FUNCTION>
+    static float with (const COMPONENT &component, FUNCTION &&function) {
+        if constexpr (is_request_response_disabled<COMPONENT>::value)
+            return NAN;
+        else
+            return component.decode () ? static_cast<float> (function (component)) : NAN;
+    }
+
+public:
+    static constexpr Field FIELDS [] = {
+        { "voltage", 0x90, [] (const MANAGER &m) { return with (m.conditions.status, [] (const auto &c) { return c.voltage; }); } },
+        { "current", 0x90, [] (const MANAGER &m) { return with (m.conditions.status, [] (const auto &c) { return c.current; }); } },
+        { "charge", 0x90, [] (const MANAGER &m) { return with (m.conditions.status, [] (const auto &c) { return c.charge; }); } },
+        { "cell_max", 0x91, [] (const MANAGER &m) { return with (m.conditions.voltage, [] (const auto &c) { return c.value.max; }); } },
+        { "cell_min", 0x91, [] (const MANAGER &m) { return with (m.conditions.voltage, [] (const auto &c) { return c.value.min; }); } },
+        { "cell_delta", 0x91, [] (const MANAGER &m) { return with (m.conditions.voltage, [] (const auto &c) { return c.value.max - c.value.min; }); } },
+        { "sensor_max", 0x92, [] (const MANAGER &m) { return with (m.conditions.sensor, [] (const auto &c) { return c.value.max; }); } },
+        { "sensor_min", 0x92, [] (const MANAGER &m) { return with (m.conditions.sensor, [] (const auto &c) { return c.value.min; }); } },
+        { "sensor_delta", 0x92, [] (const MANAGER &m) { return with (m.conditions.sensor, [] (const auto &c) { return c.value.max - c.value.min; }); } },
+        { "charging", 0x93, [] (const MANAGER &m) { return with (m.conditions.mosfet, [] (const auto &c) { return c.state == ChargeState::Charge; }); } },
+        { "discharging", 0x93, [] (const MANAGER &m) { return with (m.conditions.mosfet, [] (const auto &c) { return c.state == ChargeState::Discharge; }); } },
+        { "capacity", 0x93, [] (const MANAGER &m) { return with (m.conditions.mosfet, [] (const auto &c) { return c.residualCapacityAh; }); } },
+        { "cycles", 0x94, [] (const MANAGER &m) { return with (m.conditions.information, [] (const auto &c) { return c.cycles; }); } },
+        { "failures", 0x98, [] (const MANAGER &m) { return with (m.conditions.failure, [] (const auto &c) { return c.count; }); } },
+    };
+    static constexpr size_t FIELD_COUNT = sizeof (FIELDS) / sizeof (FIELDS [0]);
+    static_assert (FIELD_COUNT <= 32, "fields are tracked as bits");
+
+    explicit RuleEngine (MANAGER &manager) :
+        _manager (manager) {
+        _values.fill (NAN);
+        _subscribed = _manager.template subscribe<&RuleEngine::handleResponse> (this, Categories::Conditions, MANAGER::Events::Changed);
+    }
+    ~RuleEngine () {
+        _manager.unsubscribe (this);
+    }
+    RuleEngine (const RuleEngine &) = delete;
+    RuleEngine &operator= (const RuleEngine &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    // compiles and adds a rule, returning its index, or -1 with error () and errorPosition () set
+    int add (const char *name, const char *text) {
+        Compiler compiler (text, _code.size ());
+        Rule rule { name };
+        if (! compiler.compile (_code, rule)) {
+            _error = compiler.error;
+            _errorPosition = compiler.position ();
+            _code.resize (rule.start);
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: rule '%s' rejected at %u: %s\n", _manager.getConfig ().id.c_str (), name, static_cast<unsigned> (_errorPosition), _error);
+            return -1;
+        }
+        _error = nullptr;
+        _rules.push_back (rule);
+        for (size_t field = 0; field < FIELD_COUNT; field++)
+            if (rule.fields & (1u << field))
+                read (field);
+        run (_rules.back (), systemTicksNow (), _rules.size () - 1);
+        return static_cast<int> (_rules.size () - 1);
+    }
+    const char *error () const {
+        return _error;
+    }
+    size_t errorPosition () const {
+        return _errorPosition;
+    }
+    // activates rules whose hold has elapsed without any response changing
+    void process () {
+        if (_holding == 0)
+            return;
+        const SystemTicks_t now = systemTicksNow ();
+        for (size_t index = 0; index < _rules.size (); index++) {
+            Rule &rule = _rules [index];
+            if (rule.holding && ! rule.active && now - rule.since >= rule.hold)
+                transition (index, true);
+        }
+    }
+
+    size_t size () const {
+        return _rules.size ();
+    }
+    bool isActive (const size_t index) const {
+        return index < _rules.size () && _rules [index].active;
+    }
+    const char *name (const size_t index) const {
+        return index < _rules.size () ? _rules [index].name.c_str () : "";
+    }
+    size_t instructions () const {    // of every rule, as compiled
+        return _code.size ();
+    }
+    // runs every rule regardless of changes, e.g. to measure, returning how many ran
+    size_t evaluateAll () {
+        const SystemTicks_t now = systemTicksNow ();
+        for (size_t index = 0; index < _rules.size (); index++)
+            run (_rules [index], now, index);
+        return _rules.size ();
+    }
+
+private:
+    enum class Op : uint8_t {
+        Constant,
+        Field,
+        Negate,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        And,
+        Or,
+        Not
+    };
+    struct Instruction {
+        Op op;
+        uint8_t field;
+        float constant;
+    };
+    struct Rule {
+        String name;
+        size_t start {}, length {};
+        uint32_t fields {};    // read, as bits by FIELDS index
+        SystemTicks_t hold {}, since {};
+        bool holding {}, active {};
+    };
+
+    // recursive descent, emitting postfix code as it goes
+    class Compiler {
+    public:
+        const char *error { nullptr };
+        Compiler (const char *text, const size_t start) :
+            _text (text),
+            _at (text),
+            _start (start) { }
+        size_t position () const {
+            return static_cast<size_t> (_at - _text);
+        }
+        bool compile (std::vector<Instruction> &code, Rule &rule) {
+            _code = &code;
+            rule.start = _start;
+            if (! expression ())
+                return false;
+            while (! atEnd ()) {
+                if (keyword ("for")) {
+                    float amount;
+                    if (! number (amount))
+                        return fail ("expected a duration after 'for'");
+                    const float scale = keyword ("ms") ? 1.0f : keyword ("min") ? 60000.0f : keyword ("h") ? 3600000.0f : keyword ("s") ? 1000.0f : -1.0f;
+                    if (scale < 0.0f)
+                        return fail ("expected a unit of ms, s, min or h");
+                    rule.hold = static_cast<SystemTicks_t> (amount * scale);
+                } else if (keyword ("while")) {
+                    if (! expression ())
+                        return false;
+                    emit (Op::And);
+                } else
+                    return fail ("unexpected text");
+            }
+            if (_depth != 1)
+                return fail ("incomplete expression");
+            rule.length = code.size () - _start;
+            rule.fields = _fields;
+            return true;
+        }
+
+    private:
+        bool fail (const char *message) {
+            if (error == nullptr)
+                error = message;
+            return false;
+        }
+        void skip () {
+            while (*_at == ' ' || *_at == '\t')
+                _at++;
+        }
+        bool atEnd () {
+            skip ();
+            return *_at == '\0';
+        }
+        bool symbol (const char *text) {
+            skip ();
+            const size_t length = std::strlen (text);
+            if (std::strncmp (_at, text, length) != 0)
+                return false;
+            _at += length;
+            return true;
+        }
+        static bool isWord (const char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (c >= '0' && c <= '9');
+        }
+        bool keyword (const char *text) {
+            skip ();
+            const size_t length = std::strlen (text);
+            if (std::strncmp (_at, text, length) != 0 || isWord (_at [length]))
+                return false;
+            _at += length;
+            return true;
+        }
+        bool number (float &value) {
+            skip ();
+            char *end;
+            value = std::strtof (_at, &end);
+            if (end == _at || ! (isdigit (static_cast<unsigned char> (*_at)) || *_at == '.'))
+                return false;
+            _at = end;
+            return true;
+        }
+        bool emit (const Op op, const uint8_t field = 0, const float constant = 0.0f) {
+            if (op == Op::Constant || op == Op::Field) {
+                if (++_depth > DALYBMS_RULES_DEPTH)
+                    return fail ("too deeply nested");
+            } else if (op != Op::Negate && op != Op::Not)
+                _depth--;
+            _code->push_back ({ op, field, constant });
+            return true;
+        }
+        // a field, matching its name with any of its underscores written as spaces
+        bool field () {
+            skip ();
+            for (size_t index = 0; index < FIELD_COUNT; index++) {
+                const char *name = FIELDS [index].name, *at = _at;
+                while (*name != '\0' && (*at == *name || (*name == '_' && *at == ' '))) {
+                    if (*name == '_')
+                        while (at [1] == ' ')
+                            at++;
+                    name++, at++;
+                }
+                if (*name == '\0' && ! isWord (*at)) {
+                    _at = at;
+                    _fields |= (1u << index);
+                    return emit (Op::Field, static_cast<uint8_t> (index));
+                }
+            }
+            return false;
+        }
+        bool expression () {
+            if (! conjunction ())
+                return false;
+            while (keyword ("or") || symbol ("||"))
+                if (! conjunction () || ! emit (Op::Or))
+                    return false;
+            return true;
+        }
+        bool conjunction () {
+            if (! negation ())
+                return false;
+            while (keyword ("and") || symbol ("&&"))
+                if (! negation () || ! emit (Op::And))
+                    return false;
+            return true;
+        }
+        bool negation () {
+            skip ();
+            if (keyword ("not") || (_at [0] == '!' && _at [1] != '=' && symbol ("!")))
+                return nested ([this] { return negation (); }) && emit (Op::Not);
+            return comparison ();
+        }
+        bool comparison () {
+            if (! sum ())
+                return false;
+            static constexpr struct {
+                const char *text;
+                Op op;
+            } OPERATORS [] = { { "<=", Op::LessEqual }, { ">=", Op::GreaterEqual }, { "==", Op::Equal }, { "!=", Op::NotEqual }, { "<", Op::Less }, { ">", Op::Greater }, { "=", Op::Equal } };
+            for (const auto &candidate : OPERATORS)
+                if (symbol (candidate.text))
+                    return sum () && emit (candidate.op);
+            return true;
+        }
+        bool sum () {
+            if (! product ())
+                return false;
+            for (;;)
+                if (symbol ("+")) {
+                    if (! product () || ! emit (Op::Add))
+                        return false;
+                } else if (symbol ("-")) {
+                    if (! product () || ! emit (Op::Subtract))
+                        return false;
+                } else
+                    return true;
+        }
+        bool product () {
+            if (! unary ())
+                return false;
+            for (;;)
+                if (symbol ("*")) {
+                    if (! unary () || ! emit (Op::Multiply))
+                        return false;
+                } else if (symbol ("/")) {
+                    if (! unary () || ! emit (Op::Divide))
+                        return false;
+                } else
+                    return true;
+        }
+        template <typename FUNCTION>
+        bool nested (FUNCTION &&function) {    // bounds the recursion, as the stack bounds evaluation
+            if (_nesting >= DALYBMS_RULES_DEPTH)
+                return fail ("too deeply nested");
+            _nesting++;
+            const bool result = function ();
+            _nesting--;
+            return result;
+        }
+        bool unary () {
+            if (symbol ("-"))
+                return nested ([this] { return unary (); }) && emit (Op::Negate);
+            if (symbol ("("))
+                return nested ([this] { return expression (); }) && (symbol (")") || fail ("expected ')'"));
+            float value;
+            if (number (value)) {
+                static constexpr struct {
+                    const char *text;
+                    float scale;
+                } UNITS [] = { { "mV", 0.001f }, { "V", 1.0f }, { "Ah", 1.0f }, { "A", 1.0f }, { "\xC2\xB0" "C", 1.0f }, { "C", 1.0f }, { "%", 1.0f } };
+                for (const auto &unit : UNITS)
+                    if (keyword (unit.text)) {
+                        value *= unit.scale;
+                        break;
+                    }
+                return emit (Op::Constant, 0, value);
+            }
+            if (field ())
+                return true;
+            return fail ("expected a number, field or '('");
+        }
+
+        const char *_text, *_at;
+        const size_t _start;
+        std::vector<Instruction> *_code {};
+        size_t _depth {}, _nesting {};
+        uint32_t _fields {};
+    };
+
+    float execute (const Rule &rule) const {
+        std::array<float, DALYBMS_RULES_DEPTH> stack;
+        size_t top = 0;
+        for (const Instruction *instruction = &_code [rule.start], *end = instruction + rule.length; instruction < end; instruction++) {
+            switch (instruction->op) {
+            case Op::Constant :
+                stack [top++] = instruction->constant;
+                continue;
+            case Op::Field :
+                stack [top++] = _values [instruction->field];
+                continue;
+            case Op::Negate :
+                stack [top - 1] = -stack [top - 1];
+                continue;
+            case Op::Not :
+                stack [top - 1] = stack [top - 1] == 0.0f ? 1.0f : 0.0f;
+                continue;
+            default :
+                break;
+            }
+            const float b = stack [--top], a = stack [top - 1];
+            float &result = stack [top - 1];
+            switch (instruction->op) {
+            case Op::Add :
+                result = a + b;
+                break;
+            case Op::Subtract :
+                result = a - b;
+                break;
+            case Op::Multiply :
+                result = a * b;
+                break;
+            case Op::Divide :
+                result = a / b;
+                break;
+            case Op::Less :
+                result = a < b;
+                break;
+            case Op::LessEqual :
+                result = a <= b;
+                break;
+            case Op::Greater :
+                result = a > b;
+                break;
+            case Op::GreaterEqual :
+                result = a >= b;
+                break;
+            case Op::Equal :
+                result = a == b;
+                break;
+            case Op::NotEqual :
+                result = a != b;    // NaN compares unequal, i.e. true
+                break;
+            case Op::And :
+                result = (a != 0.0f && ! std::isnan (a)) && (b != 0.0f && ! std::isnan (b));
+                break;
+            case Op::Or :
+                result = (a != 0.0f && ! std::isnan (a)) || (b != 0.0f && ! std::isnan (b));
+                break;
+            default :
+                break;
+            }
+        }
+        return stack [0];
+    }
+    void run (Rule &rule, const SystemTicks_t now, const size_t index) {
+        const float result = (rule.fields & _invalid) ? 0.0f : execute (rule);
+        const bool holds = result != 0.0f && ! std::isnan (result);
+        if (holds && ! rule.holding) {
+            rule.holding = true;
+            rule.since = now;
+            _holding++;
+        } else if (! holds && rule.holding) {
+            rule.holding = false;
+            _holding--;
+        }
+        if (holds && ! rule.active && now - rule.since >= rule.hold)
+            transition (index, true);
+        else if (! holds && rule.active)
+            transition (index, false);
+    }
+    void transition (const size_t index, const bool active) {
+        Rule &rule = _rules [index];
+        rule.active = active;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: rule '%s' %s\n", _manager.getConfig ().id.c_str (), rule.name.c_str (), active ? "active" : "inactive");
+        const RuleEvent event { index, rule.name.c_str (), active };
+        notifyHandlers (event);
+    }
+
+    void read (const size_t field) {
+        _values [field] = FIELDS [field].read (_manager);
+        if (std::isnan (_values [field]))
+            _invalid |= (1u << field);
+        else
+            _invalid &= ~(1u << field);
+    }
+    bool handleResponse (RequestResponse &response) {
+        uint32_t changed = 0;
+        for (size_t field = 0; field < FIELD_COUNT; field++)
+            if (FIELDS [field].command == response.getCommand ()) {
+                read (field);
+                changed |= (1u << field);
+            }
+        if (changed == 0)
+            return false;
+        const SystemTicks_t now = systemTicksNow ();
+        for (size_t index = 0; index < _rules.size (); index++)
+            if (_rules [index].fields & changed)
+                run (_rules [index], now, index);
+        return false;
+    }
+
+    MANAGER &_manager;
+    std::vector<Instruction> _code {};
+    std::vector<Rule> _rules {};
+    std::array<float, FIELD_COUNT> _values {};
+    uint32_t _invalid { (FIELD_COUNT < 32 ? (1u << FIELD_COUNT) : 0u) - 1u };    // fields reading NaN, whose rules do not hold
+    size_t _holding {};
+    const char *_error { nullptr };
+    size_t _errorPosition {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -0,0 +1,444 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSRequestResponse.hpp"
+#include "DalyBMSManager.hpp"
+#include "DalyBMSConnectorPosix.hpp"
+#include "DalyBMSConnectorCan.hpp"
+#endif
+
+#include <vector>
+#include <deque>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// simulated device answering request frames with plausible response frames, for testing and
+// measurement without hardware; values are fixed unless changed through the public state
+
+class Simulator {
+public:
+    struct State {
+        std::vector<uint16_t> cellVoltagesMv = std::vector<uint16_t> (16, 3300);
+        std::vector<int8_t> sensorTemperaturesC = std::vector<int8_t> (2, 25);
+        float currentA { 0.0f };
+        float chargePercent { 75.0f };
+        uint32_t residualCapacityMah { 75000 };
+        uint32_t packCapacityMah { 100000 };
+        uint8_t state { 0x00 };
+        bool mosCharge { true }, mosDischarge { true };
+        uint16_t cycles { 42 };
+        uint64_t failures { 0 };
+        String hardware { "DL-SIMULATOR-HW-0001" };
+        String software { "DL-SIMULATOR-SW-0001" };
+        size_t hardwareFrames { 2 }, softwareFrames { 2 };    // as most devices, others answer with more
+        String batteryCode { "SIMULATED-BATTERY-CODE" };
+        std::vector<uint8_t> unanswered {};    // commands to ignore, as a device lacking them would
+    } state;
+
+    using Frames = std::vector<RequestResponseFrame>;
+
+    size_t respond (const RequestResponseFrame &request, Frames &frames) const {
+        const size_t before = frames.size ();
+        if (std::find (state.unanswered.begin (), state.unanswered.end (), request.getCommand ()) != state.unanswered.end ())
+            return 0;
+        switch (request.getCommand ()) {
+        case 0x50 :
+            frames.push_back (frame (0x50).setUInt32 (0, state.packCapacityMah).setUInt32 (4, 3200));
+            break;
+        case 0x51 :
+            frames.push_back (frame (0x51).setUInt8 (0, 1).setUInt8 (1, static_cast<uint8_t> (state.cellVoltagesMv.size ())).setUInt8 (4, static_cast<uint8_t> (state.sensorTemperaturesC.size ())));
+            break;
+        case 0x52 :
+            frames.push_back (frame (0x52).setUInt32 (0, 1234).setUInt32 (4, 1200));
+            break;
+        case 0x53 :
+            frames.push_back (frame (0x53).setUInt8 (0, 0x01).setUInt8 (1, 0x01).setUInt8 (2, 24).setUInt8 (3, 6).setUInt8 (4, 1).setUInt8 (5, 60));
+            break;
+        case 0x57 :
+            string (0x57, state.batteryCode, 5, frames);
+            break;
+        case 0x59 :
+            frames.push_back (frame (0x59).setUInt16 (0, 3650).setUInt16 (2, 3700).setUInt16 (4, 2800).setUInt16 (6, 2700));
+            break;
+        case 0x5A :
+            frames.push_back (frame (0x5A).setUInt16 (0, 584).setUInt16 (2, 592).setUInt16 (4, 448).setUInt16 (6, 432));
+            break;
+        case 0x5B :
+            frames.push_back (frame (0x5B).setUInt16 (0, 31000).setUInt16 (2, 31500).setUInt16 (4, 29000).setUInt16 (6, 28500));
+            break;
+        case 0x5C :
+            frames.push_back (frame (0x5C).setUInt8 (0, 95).setUInt8 (1, 100).setUInt8 (2, 40).setUInt8 (3, 35).setUInt8 (4, 100).setUInt8 (5, 105).setUInt8 (6, 30).setUInt8 (7, 25));
+            break;
+        case 0x5D :
+            frames.push_back (frame (0x5D).setUInt16 (0, 1000).setUInt16 (2, 1000).setUInt16 (4, 100).setUInt16 (6, 50));
+            break;
+        case 0x5E :
+            frames.push_back (frame (0x5E).setUInt16 (0, 100).setUInt16 (2, 200).setUInt8 (4, 55).setUInt8 (5, 60));
+            break;
+        case 0x5F :
+            frames.push_back (frame (0x5F).setUInt16 (0, 3400).setUInt16 (2, 30));
+            break;
+        case 0x60 :
+            frames.push_back (frame (0x60).setUInt16 (0, 500).setUInt16 (2, 1));
+            break;
+        case 0x61 :
+            frames.push_back (frame (0x61).setUInt8 (0, 24).setUInt8 (1, 6).setUInt8 (2, 1).setUInt8 (3, 12));
+            break;
+        case 0x62 :
+            string (0x62, state.software, state.softwareFrames, frames);
+            break;
+        case 0x63 :
+            string (0x63, state.hardware, state.hardwareFrames, frames);
+            break;
+        case 0x90 :
+            frames.push_back (frame (0x90).setUInt16 (0, static_cast<uint16_t> (packVoltageMv () / 100)).setUInt16 (4, static_cast<uint16_t> (30000 + state.currentA * 10.0f)).setUInt16 (6, static_cast<uint16_t> (state.chargePercent * 10.0f)));
+            break;
+        case 0x91 : {
+            const auto [min, max] = std::minmax_element (state.cellVoltagesMv.begin (), state.cellVoltagesMv.end ());
+            frames.push_back (frame (0x91).setUInt16 (0, *max).setUInt8 (2, static_cast<uint8_t> (1 + (max - state.cellVoltagesMv.begin ()))).setUInt16 (3, *min).setUInt8 (5, static_cast<uint8_t> (1 + (min - state.cellVoltagesMv.begin ()))));
+        } break;
+        case 0x92 : {
+            const auto [min, max] = std::minmax_element (state.sensorTemperaturesC.begin (), state.sensorTemperaturesC.end ());
+            frames.push_back (frame (0x92).setUInt8 (0, static_cast<uint8_t> (*max + 40)).setUInt8 (1, static_cast<uint8_t> (1 + (max - state.sensorTemperaturesC.begin ()))).setUInt8 (2, static_cast<uint8_t> (*min + 40)).setUInt8 (3, static_cast<uint8_t> (1 + (min - state.sensorTemperaturesC.begin ()))));
+        } break;
+        case 0x93 :
+            frames.push_back (frame (0x93).setUInt8 (0, state.state).setUInt8 (1, state.mosCharge).setUInt8 (2, state.mosDischarge).setUInt8 (3, 1).setUInt32 (4, state.residualCapacityMah));
+            break;
+        case 0x94 :
+            frames.push_back (frame (0x94).setUInt8 (0, static_cast<uint8_t> (state.cellVoltagesMv.size ())).setUInt8 (1, static_cast<uint8_t> (state.sensorTemperaturesC.size ())).setUInt8 (2, state.mosCharge).setUInt8 (3, state.mosDischarge).setUInt16 (5, state.cycles));
+            break;
+        case 0x95 :
+            for (size_t number = 1, index = 0; index < state.cellVoltagesMv.size (); number++) {
+                auto &f = frames.emplace_back (frame (0x95).setUInt8 (0, static_cast<uint8_t> (number)));
+                for (size_t i = 0; i < 3; i++, index++)
+                    f.setUInt16 (1 + i * 2, index < state.cellVoltagesMv.size () ? state.cellVoltagesMv [index] : 0);
+                f.finalize ();
+            }
+            break;
+        case 0x96 :
+            for (size_t number = 1, index = 0; index < state.sensorTemperaturesC.size (); number++) {
+                auto &f = frames.emplace_back (frame (0x96).setUInt8 (0, static_cast<uint8_t> (number)));
+                for (size_t i = 0; i < 7; i++, index++)
+                    f.setUInt8 (1 + i, index < state.sensorTemperaturesC.size () ? static_cast<uint8_t> (state.sensorTemperaturesC [index] + 40) : 0);
+                f.finalize ();
+            }
+            break;
+        case 0x97 :
+            frames.push_back (frame (0x97));
+            break;
+        case 0x98 : {
+            auto &f = frames.emplace_back (frame (0x98));
+            for (size_t i = 0; i < 7; i++)
+                f.setUInt8 (i, static_cast<uint8_t> (state.failures >> (i * 8)));
+            f.setUInt8 (7, state.failures ? 0x03 : 0x00);
+        } break;
+        case 0x00 :
+        case 0xD9 :
+        case 0xDA :
+            frames.push_back (frame (request.getCommand ()).setUInt8 (0, request.getUInt8 (0)));
+            break;
+        default :    // e.g. 0x54, which real devices do not answer
+            break;
+        }
+        for (size_t i = before; i < frames.size (); i++)
+            frames [i].finalize ();
+        return frames.size () - before;
+    }
+
+private:
+    uint32_t packVoltageMv () const {
+        uint32_t total = 0;
+        for (const auto &v : state.cellVoltagesMv)
+            total += v;
+        return total;
+    }
+    static RequestResponseFrame frame (const uint8_t command) {
+        RequestResponseFrame f;
+        f.setAddress (RequestResponseFrame::Constants::VALUE_ADDRESS_BMS_MASTER);
+        f.setCommand (command);
+        return f;
+    }
+    static void string (const uint8_t command, const String &value, const size_t count, Frames &frames) {
+        for (size_t number = 1; number <= count; number++) {
+            auto &f = frames.emplace_back (frame (command).setUInt8 (0, static_cast<uint8_t> (number)));
+            for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA - 1; i++) {
+                const size_t index = (number - 1) * (RequestResponseFrame::Constants::SIZE_DATA - 1) + i;
+                f.setUInt8 (1 + i, index < value.length () ? value [index] : ' ');
+            }
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------------------------
+
+// connector looped back to a simulator: by default responses are available to read as soon as the
+// request has been written; a Line adds the device turnaround, the time on the wire, and a bounded
+// receive buffer that drops what arrives while it is full, as a UART driver would
+
+class SimulatorConnector : public RequestResponseFrame::Receiver {
+public:
+    struct Line {
+        size_t bufferRx { 0 };          // bytes, 0 unbounded
+        uint32_t turnaroundUs { 0 };    // from end of request to start of response
+        uint32_t byteUs { 0 };          // per byte, ~1042 at 9600 baud
+        uint32_t recoveryUs { 0 };      // requests closer than this to the previous are silently ignored
+        size_t queueDepth { 0 };        // requests awaiting or in answer at most, further ones ignored, 0 unbounded
+    };
+
+    explicit SimulatorConnector (Simulator &simulator) :
+        _simulator (simulator) {
+    }
+    SimulatorConnector (Simulator &simulator, const Line &line) :
+        _simulator (simulator),
+        _line (line) {
+    }
+
+    size_t dropped () const {    // bytes lost to a full receive buffer
+        return _dropped;
+    }
+    size_t ignored () const {    // requests the device did not answer for lack of recovery or queue
+        return _ignored;
+    }
+
+protected:
+    void begin () override {
+    }
+    void end () override {
+    }
+    bool readByte (uint8_t *byte) override {
+        arrive ();
+        if (_bytes.empty ())
+            return false;
+        *byte = _bytes.front ();
+        _bytes.pop_front ();
+        return true;
+    }
+    bool writeBytes (const uint8_t *data, const size_t size) override {
+        if (size != RequestResponseFrame::size ())
+            return false;
+        arrive ();
+        const unsigned long now = micros ();
+        const bool early = _requested && static_cast<long> (now - _requestedAt) < static_cast<long> (_line.recoveryUs);
+        _requested = true;
+        _requestedAt = now;
+        while (! _answering.empty () && static_cast<long> (now - _answering.front ()) >= 0)
+            _answering.pop_front ();
+        if (early || (_line.queueDepth > 0 && _answering.size () >= _line.queueDepth)) {
+            _ignored++;
+            return true;
+        }
+        RequestResponseFrame request;
+        request.setCommand (data [RequestResponseFrame::Constants::OFFSET_COMMAND]);
+        for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA; i++)
+            request.setUInt8 (i, data [RequestResponseFrame::Constants::SIZE_HEADER + i]);
+        _frames.clear ();
+        _simulator.respond (request, _frames);
+        unsigned long time = now + _line.turnaroundUs + size * _line.byteUs;
+        if (! _answering.empty () && static_cast<long> (_answering.back () - time) > 0)
+            time = _answering.back ();    // the device answers one request at a time
+        for (const auto &frame : _frames)
+            for (size_t i = 0; i < frame.size (); i++)
+                _wire.push_back ({ time += _line.byteUs, frame.data () [i] });
+        _answering.push_back (time);
+        return true;
+    }
+
+private:
+    void arrive () {
+        const unsigned long now = micros ();
+        while (! _wire.empty () && static_cast<long> (now - _wire.front ().first) >= 0) {
+            if (_line.bufferRx == 0 || _bytes.size () < _line.bufferRx)
+                _bytes.push_back (_wire.front ().second);
+            else
+                _dropped++;
+            _wire.pop_front ();
+        }
+    }
+
+    Simulator &_simulator;
+    const Line _line {};
+    Simulator::Frames _frames {};
+    std::deque<std::pair<unsigned long, uint8_t>> _wire {};
+    std::deque<uint8_t> _bytes {};
+    std::deque<unsigned long> _answering {};
+    bool _requested {};
+    unsigned long _requestedAt {};
+    size_t _dropped {}, _ignored {};
+};
+
+#if defined(__linux__)
+
+// -----------------------------------------------------------------------------------------------
+
+// simulator on the master side of a pseudo-terminal pair, so that a PosixConnector opened on
+// device () is exercised end to end through the kernel tty layer
+
+class PosixSimulatorPort {
+public:
+    explicit PosixSimulatorPort (Simulator &simulator) :
+        _simulator (simulator) {
+        if ((_master = ::posix_openpt (O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)) < 0 || ::grantpt (_master) < 0 || ::unlockpt (_master) < 0) {
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<simulator>: pty failed: %s\n", ::strerror (errno));
+            return;
+        }
+        _device = ::ptsname (_master);
+        struct termios tty;
+        if (::tcgetattr (_master, &tty) == 0) {
+            ::cfmakeraw (&tty);
+            ::tcsetattr (_master, TCSANOW, &tty);
+        }
+    }
+    ~PosixSimulatorPort () {
+        if (_master >= 0)
+            ::close (_master);
+    }
+    PosixSimulatorPort (const PosixSimulatorPort &) = delete;
+    PosixSimulatorPort &operator= (const PosixSimulatorPort &) = delete;
+
+    const String &device () const {
+        return _device;
+    }
+    int fd () const {
+        return _master;
+    }
+    // answers every complete request waiting on the master side, returning how many
+    size_t serve () {
+        size_t served = 0;
+        ssize_t result;
+        while ((result = ::read (_master, _buffer.data () + _buffered, _buffer.size () - _buffered)) > 0 || (result < 0 && errno == EINTR))
+            if (result > 0)
+                _buffered += static_cast<size_t> (result);
+        size_t offset = 0;
+        while (_buffered - offset >= RequestResponseFrame::size ()) {
+            if (_buffer [offset] != RequestResponseFrame::Constants::VALUE_BYTE_START) {
+                offset++;
+                continue;
+            }
+            RequestResponseFrame request;
+            request.setCommand (_buffer [offset + RequestResponseFrame::Constants::OFFSET_COMMAND]);
+            for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA; i++)
+                request.setUInt8 (i, _buffer [offset + RequestResponseFrame::Constants::SIZE_HEADER + i]);
+            _frames.clear ();
+            _simulator.respond (request, _frames);
+            for (const auto &frame : _frames)
+                writeAll (frame.data (), frame.size ());
+            offset += RequestResponseFrame::size ();
+            served++;
+        }
+        std::memmove (_buffer.data (), _buffer.data () + offset, _buffered - offset);
+        _buffered -= offset;
+        return served;
+    }
+
+private:
+    void writeAll (const uint8_t *data, const size_t size) {
+        for (size_t offset = 0; offset < size;) {
+            const ssize_t written = ::write (_master, data + offset, size - offset);
+            if (written > 0)
+                offset += static_cast<size_t> (written);
+            else if (written < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                return;
+            else if (written < 0 && errno != EINTR) {
+                struct pollfd writable = { .fd = _master, .events = POLLOUT, .revents = 0 };
+                ::poll (&writable, 1, 100);
+            }
+        }
+    }
+
+    Simulator &_simulator;
+    int _master { -1 };
+    String _device;
+    std::array<uint8_t, 1024> _buffer {};
+    size_t _buffered {};
+    Simulator::Frames _frames {};
+};
+
+// -----------------------------------------------------------------------------------------------
+
+// simulator as a pack on a SocketCAN interface (vcan0 for testing: `ip link add dev vcan0 type
+// vcan && ip link set up vcan0`), answering requests addressed to it and, on demand, broadcasting
+// responses unasked as a pack configured to stream would
+
+class CanSimulatorPort {
+public:
+    CanSimulatorPort (Simulator &simulator, const String &interface, const uint8_t address = CanProtocol::ADDRESS_BMS) :
+        _simulator (simulator),
+        _interface (interface),
+        _address (address) {
+        if ((_fd = CanProtocol::open (interface, CanProtocol::ADDRESS_HOST, address)) < 0)
+            ALWAYS_DEBUG_PRINTF ("DalyBMS<simulator>: %s failed: %s\n", interface.c_str (), ::strerror (errno));
+    }
+    ~CanSimulatorPort () {
+        if (_fd >= 0)
+            ::close (_fd);
+    }
+    CanSimulatorPort (const CanSimulatorPort &) = delete;
+    CanSimulatorPort &operator= (const CanSimulatorPort &) = delete;
+
+    bool isOpen () const {
+        return _fd >= 0;
+    }
+    int fd () const {
+        return _fd;
+    }
+    // answers every request waiting, returning how many
+    size_t serve () {
+        size_t served = 0;
+        struct can_frame frame;
+        ssize_t result;
+        while ((result = ::read (_fd, &frame, sizeof (frame))) == static_cast<ssize_t> (sizeof (frame)) || (result < 0 && errno == EINTR)) {
+            if (result < 0 || (frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) != CAN_EFF_FLAG || frame.can_dlc != RequestResponseFrame::Constants::SIZE_DATA)
+                continue;
+            RequestResponseFrame request;
+            request.setCommand (CanProtocol::command (frame.can_id));
+            for (size_t i = 0; i < RequestResponseFrame::Constants::SIZE_DATA; i++)
+                request.setUInt8 (i, frame.data [i]);
+            transmit (request);
+            served++;
+        }
+        return served;
+    }
+    // sends the responses to each command unasked, returning the frames sent
+    size_t broadcast (const std::vector<uint8_t> &commands) {
+        size_t sent = 0;
+        for (const auto command : commands) {
+            RequestResponseFrame request;
+            request.setCommand (command);
+            sent += transmit (request);
+        }
+        return sent;
+    }
+
+private:
+    size_t transmit (const RequestResponseFrame &request) {
+        _frames.clear ();
+        _simulator.respond (request, _frames);
+        size_t sent = 0;
+        for (const auto &frame : _frames)
+            if (CanProtocol::send (_fd, CanProtocol::toCan (frame.getCommand (), CanProtocol::ADDRESS_HOST, _address, frame.data () + RequestResponseFrame::Constants::SIZE_HEADER), 100))
+                sent++;
+            else
+                ALWAYS_DEBUG_PRINTF ("DalyBMS<simulator>: %s write failed: %s\n", _interface.c_str (), ::strerror (errno));
+        return sent;
+    }
+
+    Simulator &_simulator;
+    const String _interface;
+    const uint8_t _address;
+    int _fd { -1 };
+    Simulator::Frames _frames {};
+};
+
+#endif    // __linux__
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
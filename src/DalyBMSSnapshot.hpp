@@ -0,0 +1,190 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <algorithm>
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct SnapshotSource {
+    size_t manager;     // index amongst the barrier's managers
+    uint8_t command;    // e.g. 0x95 from every port, 0x90 from the manager
+};
+
+struct Snapshot {
+    struct Entry {
+        SnapshotSource source;
+        RequestResponse *response;    // as received for this snapshot, valid during its publication
+        SystemTicks_t requested, received;
+        bool answered;
+    };
+    counter_t sequence {};
+    SystemTicks_t started {}, completed {};
+    SystemTicks_t skew {};      // between the first and the last response received
+    SystemTicks_t spread {};    // between the first and the last request sent
+    bool complete {};           // every source answered within the timeout
+    std::vector<Entry> entries {};
+};
+
+// captures responses from several managers (e.g. the manager and balancer ports, which measure the
+// same cells) as one coherent snapshot: waits until every manager involved is idle, then issues
+// every source's request back to back so they are on the wires together, collects the responses,
+// and publishes once to handlers when all have answered or the timeout passed. The responses are
+// referenced, not copied, and are those of the snapshot while handlers run. The skew between the
+// first and last response is recorded per snapshot and accumulated, to bound what cross-source
+// comparisons can assume
+
+template <typename MANAGER>
+class SnapshotBarrier : public Handlerable<const Snapshot &> {
+public:
+    struct Config {
+        std::vector<SnapshotSource> sources {};
+        SystemTicks_t timeout { 2000 };    // for the managers to be idle, and again for the responses
+    };
+    struct Stats {
+        counter_t captures {}, complete {}, incomplete {};
+        SystemTicks_t skewLast {}, skewMax {};
+        uint64_t skewTotal {};
+        SystemTicks_t skewMean () const {
+            return complete > 0 ? static_cast<SystemTicks_t> (skewTotal / complete) : 0;
+        }
+    };
+
+    SnapshotBarrier (const std::vector<MANAGER *> &managers, const Config &config) :
+        _managers (managers),
+        _config (config) {
+        for (const auto &source : _config.sources)
+            if (source.manager < _managers.size ())
+                _managers [source.manager]->forEachComponent ([&] (const size_t, const Categories, auto &component) {
+                    if (component.getCommand () == source.command) {
+                        _snapshot.entries.push_back ({ source, &static_cast<RequestResponse &> (component), 0, 0, false });
+                        _subscribed = _managers [source.manager]->template subscribe<&SnapshotBarrier::handleResponse> (this, component) && _subscribed;
+                    }
+                });
+    }
+    ~SnapshotBarrier () {
+        for (auto *manager : _managers)
+            manager->unsubscribe (this);
+    }
+    SnapshotBarrier (const SnapshotBarrier &) = delete;
+    SnapshotBarrier &operator= (const SnapshotBarrier &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    // starts a snapshot, false if one is already in progress
+    bool capture () {
+        if (_state != State::Idle || _snapshot.entries.empty ())
+            return false;
+        _state = State::Waiting;
+        _snapshot.started = systemTicksNow ();
+        _snapshot.sequence++;
+        _snapshot.complete = false;
+        _snapshot.skew = _snapshot.spread = 0;
+        for (auto &entry : _snapshot.entries)
+            entry.answered = false, entry.requested = entry.received = 0;
+        process ();
+        return true;
+    }
+    void process () {
+        if (_state == State::Waiting) {
+            bool idle = true;
+            for (const auto &entry : _snapshot.entries)
+                idle = idle && _managers [entry.source.manager]->isIdle ();
+            if (idle || systemTicksNow () - _snapshot.started >= _config.timeout)
+                launch ();
+        } else if (_state == State::Collecting && systemTicksNow () - _launched >= _config.timeout)
+            publish ();
+    }
+
+    bool isCapturing () const {
+        return _state != State::Idle;
+    }
+    const Snapshot &last () const {    // the entries' responses may since have been refreshed
+        return _snapshot;
+    }
+    const Stats &stats () const {
+        return _stats;
+    }
+
+private:
+    enum class State : uint8_t {
+        Idle,
+        Waiting,    // for the managers to be idle
+        Collecting
+    };
+
+    void launch () {
+        _state = State::Collecting;
+        _launched = systemTicksNow ();
+        for (auto &entry : _snapshot.entries) {    // issue all first, as processing receives
+            entry.requested = systemTicksNow ();
+            _managers [entry.source.manager]->issue (*entry.response);
+        }
+        _snapshot.spread = _snapshot.entries.back ().requested - _snapshot.entries.front ().requested;
+    }
+    bool handleResponse (RequestResponse &response) {
+        if (_state != State::Collecting)
+            return false;
+        bool complete = true;
+        for (auto &entry : _snapshot.entries) {
+            if (entry.response == &response && ! entry.answered) {
+                entry.answered = true;
+                entry.received = systemTicksNow ();
+            }
+            complete = complete && entry.answered;
+        }
+        if (complete)
+            publish ();
+        return false;
+    }
+    void publish () {
+        _state = State::Idle;
+        _snapshot.completed = systemTicksNow ();
+        SystemTicks_t first = 0, last = 0;
+        bool any = false;
+        _snapshot.complete = true;
+        for (const auto &entry : _snapshot.entries)
+            if (entry.answered) {
+                first = any ? std::min (first, entry.received) : entry.received;
+                last = any ? std::max (last, entry.received) : entry.received;
+                any = true;
+            } else
+                _snapshot.complete = false;
+        _snapshot.skew = last - first;
+        _stats.captures++;
+        if (_snapshot.complete) {
+            _stats.complete++;
+            _stats.skewLast = _snapshot.skew;
+            _stats.skewMax = std::max (_stats.skewMax, _snapshot.skew);
+            _stats.skewTotal += _snapshot.skew;
+        } else
+            _stats.incomplete++;
+        DALYBMS_DEBUG_PRINTF ("DalyBMS: snapshot %lu %s, skew %lums, spread %lums, %lums\n", static_cast<unsigned long> (_snapshot.sequence), _snapshot.complete ? "complete" : "incomplete", static_cast<unsigned long> (_snapshot.skew), static_cast<unsigned long> (_snapshot.spread), static_cast<unsigned long> (_snapshot.completed - _snapshot.started));
+        notifyHandlers (_snapshot);
+    }
+
+    const std::vector<MANAGER *> _managers;
+    const Config _config;
+    Snapshot _snapshot {};
+    Stats _stats {};
+    State _state { State::Idle };
+    SystemTicks_t _launched {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -0,0 +1,163 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#endif
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#if defined(ESP32)
+#include <Preferences.h>
+#endif
+#if defined(__linux__)
+#include <cstdio>
+#endif
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+// small persistent blobs by key (at most 15 characters, the NVS limit), for results worth keeping
+// across restarts; storeKey () derives such a key from arbitrary text, e.g. hardware/software ids
+
+class Store {
+public:
+    virtual ~Store () = default;
+    virtual size_t load (const String &key, uint8_t *data, const size_t size) = 0;    // bytes loaded, 0 if absent
+    virtual bool save (const String &key, const uint8_t *data, const size_t size) = 0;
+    virtual bool remove (const String &key) = 0;
+
+    template <typename T>
+    bool load (const String &key, T &value) {
+        static_assert (std::is_trivially_copyable_v<T>);
+        return load (key, reinterpret_cast<uint8_t *> (&value), sizeof (T)) == sizeof (T);
+    }
+    template <typename T>
+    bool save (const String &key, const T &value) {
+        static_assert (std::is_trivially_copyable_v<T>);
+        return save (key, reinterpret_cast<const uint8_t *> (&value), sizeof (T));
+    }
+};
+
+inline String storeKey (const char *prefix, const String &text) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < text.length (); i++)
+        hash = (hash ^ static_cast<uint8_t> (text [i])) * 16777619u;
+    char key [16];
+    snprintf (key, sizeof (key), "%.6s%08lx", prefix, static_cast<unsigned long> (hash));
+    return String (key);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+class MemoryStore : public Store {
+public:
+    size_t load (const String &key, uint8_t *data, const size_t size) override {
+        const auto it = _items.find (key);
+        if (it == _items.end ())
+            return 0;
+        const size_t length = std::min (size, it->second.size ());
+        std::memcpy (data, it->second.data (), length);
+        return length;
+    }
+    bool save (const String &key, const uint8_t *data, const size_t size) override {
+        _items [key].assign (data, data + size);
+        return true;
+    }
+    bool remove (const String &key) override {
+        return _items.erase (key) > 0;
+    }
+
+private:
+    struct Less {
+        bool operator() (const String &a, const String &b) const {
+            return std::strcmp (a.c_str (), b.c_str ()) < 0;
+        }
+    };
+    std::map<String, std::vector<uint8_t>, Less> _items {};
+};
+
+// -----------------------------------------------------------------------------------------------
+
+#if defined(ESP32)
+class PreferencesStore : public Store {
+public:
+    explicit PreferencesStore (const char *name = "dalybms") :
+        _name (name) {
+    }
+    size_t load (const String &key, uint8_t *data, const size_t size) override {
+        if (! _preferences.begin (_name, true))
+            return 0;
+        const size_t length = _preferences.isKey (key.c_str ()) ? _preferences.getBytes (key.c_str (), data, size) : 0;
+        _preferences.end ();
+        return length;
+    }
+    bool save (const String &key, const uint8_t *data, const size_t size) override {
+        if (! _preferences.begin (_name, false))
+            return false;
+        const bool result = _preferences.putBytes (key.c_str (), data, size) == size;
+        _preferences.end ();
+        return result;
+    }
+    bool remove (const String &key) override {
+        if (! _preferences.begin (_name, false))
+            return false;
+        const bool result = _preferences.remove (key.c_str ());
+        _preferences.end ();
+        return result;
+    }
+
+private:
+    const char *_name;
+    Preferences _preferences;
+};
+#endif
+
+// -----------------------------------------------------------------------------------------------
+
+#if defined(__linux__)
+class FileStore : public Store {
+public:
+    explicit FileStore (const String &directory) :
+        _directory (directory) {
+    }
+    size_t load (const String &key, uint8_t *data, const size_t size) override {
+        FILE *file = std::fopen (path (key).c_str (), "rb");
+        if (file == nullptr)
+            return 0;
+        const size_t length = std::fread (data, 1, size, file);
+        std::fclose (file);
+        return length;
+    }
+    bool save (const String &key, const uint8_t *data, const size_t size) override {
+        const String target = path (key), temporary = target + ".tmp";
+        FILE *file = std::fopen (temporary.c_str (), "wb");
+        if (file == nullptr)
+            return false;
+        const bool written = std::fwrite (data, 1, size, file) == size;
+        if (std::fclose (file) != 0 || ! written)
+            return false;
+        return std::rename (temporary.c_str (), target.c_str ()) == 0;    // atomic replace
+    }
+    bool remove (const String &key) override {
+        return std::remove (path (key).c_str ()) == 0;
+    }
+
+private:
+    String path (const String &key) const {
+        return _directory + "/" + key;
+    }
+    const String _directory;
+};
+#endif
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -0,0 +1,273 @@
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+#ifndef DALYBMS_FLATFILES
+#pragma once
+#include "DalyBMSUtilities.hpp"
+#include "DalyBMSManager.hpp"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace daly_bms {
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+struct ThresholdEvent {
+    enum class Quantity : uint8_t {
+        CellVoltage,              // 0x91/0x95 against 0x59
+        PackVoltage,              // 0x90 against 0x5A
+        Current,                  // 0x90 against 0x5B, high is charging, low is discharging
+        Charge,                   // 0x90 against 0x5D
+        Temperature,              // 0x92/0x96 against 0x5C, charge or discharge limits by the current
+        CellVoltageDifference,    // 0x91/0x95 against 0x5E, high only
+        TemperatureDifference,    // 0x92/0x96 against 0x5E, high only
+        Count
+    };
+    enum class Bound : uint8_t {
+        High,
+        Low
+    };
+    enum class Level : uint8_t {
+        Normal,
+        Approaching,    // projected to reach L1 within the horizon
+        L1,
+        L2
+    };
+    Quantity quantity;
+    Bound bound;
+    Level level, previous;
+    float value, limit;    // limit: of the level reached, or of the next one if Normal or Approaching
+    float seconds;         // projected until the next limit at the current slope, negative if not approaching
+    static const char *getQuantityName (const Quantity quantity) {
+        static constexpr const char *NAMES [] = { "cell voltage", "pack voltage", "current", "charge", "temperature", "cell voltage difference", "temperature difference" };
+        return quantity < Quantity::Count ? NAMES [static_cast<size_t> (quantity)] : "unknown";
+    }
+    static const char *getLevelName (const Level level) {
+        return level == Level::L2 ? "L2" : level == Level::L1 ? "L1" : level == Level::Approaching ? "approaching" : "normal";
+    }
+};
+
+// evaluates each status, extremes, cell voltage and temperature response against the limits the
+// BMS itself reported (Thresholds, once valid, e.g. restored by the Cache) as it arrives, rather than
+// waiting for the failure bits of a later 0x98. Every quantity and bound keeps a smoothed slope,
+// giving the projected time to its next limit; level changes, including Approaching when the
+// projection falls within the horizon, are passed to handlers. No requests are issued
+//
+// Note, the limits are the BMS's own alarm levels, so a projection is only as good as the slope:
+// quantities that step (charge, current) project less usefully than those that drift (voltages)
+
+template <typename MANAGER>
+class ThresholdMonitor : public Handlerable<const ThresholdEvent &> {
+public:
+    using Quantity = ThresholdEvent::Quantity;
+    using Bound = ThresholdEvent::Bound;
+    using Level = ThresholdEvent::Level;
+    static constexpr size_t QUANTITIES = static_cast<size_t> (Quantity::Count);
+
+    struct Config {
+        float horizon { 60.0f };          // seconds, projections within which are Approaching
+        float release { 2.0f };           // of the horizon, beyond which Approaching is withdrawn
+        SystemTicks_t interval { 1000 };    // minimum between slope samples, as several responses carry the same quantity
+        float smoothing { 0.3f };         // weight of the newest slope sample
+    };
+    struct Projection {
+        Level level { Level::Normal };
+        float value {}, slope {};    // units per second
+        float limit {}, seconds { -1.0f };
+        bool evaluated {};
+    };
+
+    ThresholdMonitor (MANAGER &manager, const Config &config = Config ()) :
+        _manager (manager),
+        _config (config) {
+        _subscribed = _manager.template subscribe<&ThresholdMonitor::handleResponse> (this, Categories::Conditions + Categories::Diagnostics);
+    }
+    ~ThresholdMonitor () {
+        _manager.unsubscribe (this);
+    }
+    ThresholdMonitor (const ThresholdMonitor &) = delete;
+    ThresholdMonitor &operator= (const ThresholdMonitor &) = delete;
+
+    bool isSubscribed () const {    // false if the manager's or connector's handler pool was full
+        return _subscribed;
+    }
+
+    const Projection &projection (const Quantity quantity, const Bound bound) const {
+        return _trackers [index (quantity, bound)].projection;
+    }
+    // the most severe level across every quantity and bound
+    Level level () const {
+        Level result = Level::Normal;
+        for (const auto &tracker : _trackers)
+            result = std::max (result, tracker.projection.level);
+        return result;
+    }
+    // as the values observed, e.g. values computed or received otherwise
+    void evaluate (const Quantity quantity, const Bound bound, const float value) {
+        Limits limits;
+        if (limitsOf (quantity, bound, limits))
+            evaluate (_trackers [index (quantity, bound)], quantity, bound, value, limits);
+    }
+
+private:
+    struct Limits {
+        float L1 {}, L2 {};
+    };
+    struct Tracker {
+        Projection projection {};
+        float anchor {};
+        SystemTicks_t anchored {};
+        bool sampled {};
+    };
+
+    static size_t index (const Quantity quantity, const Bound bound) {
+        return static_cast<size_t> (quantity) * 2 + static_cast<size_t> (bound);
+    }
+    template <typename COMPONENT>
+    static bool isValid (const COMPONENT &component) {
+        if constexpr (is_request_response_disabled<COMPONENT>::value)
+            return false;
+        else
+            return static_cast<const RequestResponse &> (component).isValid ();
+    }
+    template <typename COMPONENT>
+    static bool fromMinmax (const COMPONENT &component, const Bound bound, Limits &limits) {
+        if constexpr (is_request_response_disabled<COMPONENT>::value)
+            return false;
+        else {
+            if (! isValid (component))
+                return false;
+            limits = bound == Bound::High ? Limits { static_cast<float> (component.value.L1.max), static_cast<float> (component.value.L2.max) } : Limits { static_cast<float> (component.value.L1.min), static_cast<float> (component.value.L2.min) };
+            return true;
+        }
+    }
+    bool limitsOf (const Quantity quantity, const Bound bound, Limits &limits) const {
+        const auto &thresholds = _manager.thresholds;
+        switch (quantity) {
+        case Quantity::CellVoltage :
+            return fromMinmax (thresholds.cell_voltage, bound, limits);
+        case Quantity::PackVoltage :
+            return fromMinmax (thresholds.voltage, bound, limits);
+        case Quantity::Current :
+            return fromMinmax (thresholds.current, bound, limits);
+        case Quantity::Charge :
+            return fromMinmax (thresholds.charge, bound, limits);
+        case Quantity::Temperature :
+            if constexpr (! is_request_response_disabled<decltype (thresholds.sensor)>::value)
+                if (isValid (thresholds.sensor)) {
+                    const auto &minmax = _current > 0.0f ? thresholds.sensor.charge : thresholds.sensor.discharge;
+                    limits = bound == Bound::High ? Limits { static_cast<float> (minmax.L1.max), static_cast<float> (minmax.L2.max) } : Limits { static_cast<float> (minmax.L1.min), static_cast<float> (minmax.L2.min) };
+                    return true;
+                }
+            return false;
+        case Quantity::CellVoltageDifference :
+        case Quantity::TemperatureDifference :
+            if constexpr (! is_request_response_disabled<decltype (thresholds.cell_sensor)>::value)
+                if (bound == Bound::High && isValid (thresholds.cell_sensor)) {
+                    const auto &difference = quantity == Quantity::CellVoltageDifference ? thresholds.cell_sensor.voltage : FrameTypeThresholdsDifference<float> { static_cast<float> (thresholds.cell_sensor.temperature.L1), static_cast<float> (thresholds.cell_sensor.temperature.L2) };
+                    limits = { difference.L1, difference.L2 };
+                    return true;
+                }
+            return false;
+        default :
+            return false;
+        }
+    }
+
+    bool handleResponse (RequestResponse &response) {
+        switch (response.getCommand ()) {
+        case 0x90 :
+            _current = response.get (&RequestResponse_STATUS::current);
+            both (Quantity::PackVoltage, response.get (&RequestResponse_STATUS::voltage));
+            both (Quantity::Current, _current);
+            both (Quantity::Charge, response.get (&RequestResponse_STATUS::charge));
+            break;
+        case 0x91 : {
+            const auto &value = response.get (&RequestResponse_VOLTAGE_MINMAX::value);
+            extremes (Quantity::CellVoltage, Quantity::CellVoltageDifference, value.min, value.max);
+        } break;
+        case 0x92 : {
+            const auto &value = response.get (&RequestResponse_SENSOR_MINMAX::value);
+            extremes (Quantity::Temperature, Quantity::TemperatureDifference, value.min, value.max);
+        } break;
+        case 0x95 :
+            extremes (Quantity::CellVoltage, Quantity::CellVoltageDifference, response.get (&RequestResponse_VOLTAGES::values));
+            break;
+        case 0x96 :
+            extremes (Quantity::Temperature, Quantity::TemperatureDifference, response.get (&RequestResponse_SENSORS::values));
+            break;
+        default :
+            break;
+        }
+        return false;
+    }
+    void both (const Quantity quantity, const float value) {
+        evaluate (quantity, Bound::High, value);
+        evaluate (quantity, Bound::Low, value);
+    }
+    template <typename TYPE>
+    void extremes (const Quantity quantity, const Quantity difference, const TYPE min, const TYPE max) {
+        evaluate (quantity, Bound::High, static_cast<float> (max));
+        evaluate (quantity, Bound::Low, static_cast<float> (min));
+        evaluate (difference, Bound::High, static_cast<float> (max) - static_cast<float> (min));
+    }
+    template <typename TYPE>
+    void extremes (const Quantity quantity, const Quantity difference, const std::vector<TYPE> &values) {
+        if (values.empty ())
+            return;
+        const auto [min, max] = std::minmax_element (values.begin (), values.end ());
+        extremes (quantity, difference, *min, *max);
+    }
+
+    void evaluate (Tracker &tracker, const Quantity quantity, const Bound bound, const float value, const Limits &limits) {
+        Projection &projection = tracker.projection;
+        const SystemTicks_t now = systemTicksNow ();
+        if (! tracker.sampled) {
+            tracker.anchor = value;
+            tracker.anchored = now;
+            tracker.sampled = true;
+        } else if (now - tracker.anchored >= _config.interval) {
+            const float slope = (value - tracker.anchor) * 1000.0f / static_cast<float> (now - tracker.anchored);
+            projection.slope = projection.evaluated ? projection.slope + _config.smoothing * (slope - projection.slope) : slope;
+            projection.evaluated = true;
+            tracker.anchor = value;
+            tracker.anchored = now;
+        }
+        projection.value = value;
+
+        const auto beyond = [bound, value] (const float limit) {
+            return bound == Bound::High ? value > limit : value < limit;
+        };
+        const Level previous = projection.level;
+        Level level = beyond (limits.L2) ? Level::L2 : beyond (limits.L1) ? Level::L1 : Level::Normal;
+        const float towards = bound == Bound::High ? projection.slope : -projection.slope, next = level == Level::Normal ? limits.L1 : limits.L2;
+        projection.seconds = (level != Level::L2 && towards > 0.0f) ? std::fabs (next - value) / towards : -1.0f;
+        projection.limit = level == Level::L1 ? limits.L1 : next;
+        if (level == Level::Normal && projection.seconds >= 0.0f && projection.seconds <= _config.horizon * (previous == Level::Approaching ? _config.release : 1.0f))
+            level = Level::Approaching;
+        projection.level = level;
+
+        if (level != previous) {
+            const ThresholdEvent event { quantity, bound, level, previous, value, projection.limit, projection.seconds };
+            DALYBMS_DEBUG_PRINTF ("DalyBMS<%s>: threshold %s %s %s -> %s, value=%.3f, limit=%.3f, seconds=%.1f\n", _manager.getConfig ().id.c_str (), ThresholdEvent::getQuantityName (event.quantity), bound == Bound::High ? "high" : "low", ThresholdEvent::getLevelName (previous), ThresholdEvent::getLevelName (level), value, projection.limit, projection.seconds);
+            notifyHandlers (event);
+        }
+    }
+
+    MANAGER &_manager;
+    const Config _config;
+    std::array<Tracker, QUANTITIES * 2> _trackers {};
+    float _current {};
+    bool _subscribed { true };
+};
+
+// -----------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------
+
+}    // namespace daly_bms
@@ -56,9 +56,13 @@ namespace daly_bms {
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
 
-#include <vector>
+#include <array>
 
-template <typename T, typename ReturnType = void>
+#ifndef DALYBMS_HANDLERS_MAX
+#define DALYBMS_HANDLERS_MAX 4
+#endif
+
+template <typename T, typename ReturnType = void, size_t CAPACITY = DALYBMS_HANDLERS_MAX>
 class Handlerable {
 public:
     class Handler {
@@ -67,31 +71,86 @@ public:
         virtual ~Handler () = default;
         virtual ReturnType handle (T t) = 0;
     };
-    void registerHandler (Handler *handler) {
-        _handlers.push_back (handler);
+    // non-owning, heap-free binding of either a Handler or a member function known at compile time
+    class Delegate {
+    public:
+        Delegate () = default;
+        explicit Delegate (Handler *handler) :
+            _context (handler),
+            _function (&invokeHandler) { }
+        template <auto METHOD, typename CONTEXT>
+        static Delegate bind (CONTEXT *context) {
+            Delegate delegate;
+            delegate._context = context;
+            delegate._function = &invokeMethod<METHOD, CONTEXT>;
+            return delegate;
+        }
+        inline ReturnType operator() (T t) const {
+            return _function (_context, t);
+        }
+        // by the pointer it was bound with: a Handler by its Handler subobject, which under multiple
+        // inheritance need not start where the context does, a method by the context itself
+        template <typename CONTEXT>
+        bool isBoundTo (const CONTEXT *context) const {
+            if constexpr (std::is_convertible_v<const CONTEXT *, const Handler *>)
+                if (_function == &invokeHandler)
+                    return _context == static_cast<const Handler *> (context);
+            return _context == static_cast<const void *> (context);
+        }
+
+    private:
+        static ReturnType invokeHandler (void *context, T t) {
+            return static_cast<Handler *> (context)->handle (t);
+        }
+        template <auto METHOD, typename CONTEXT>
+        static ReturnType invokeMethod (void *context, T t) {
+            return (static_cast<CONTEXT *> (context)->*METHOD) (t);
+        }
+        void *_context {};
+        ReturnType (*_function) (void *, T) {};
+    };
+
+    bool registerHandler (Handler *handler) {
+        return registerDelegate (Delegate (handler));
     }
-    void unregisterHandler (Handler *handler) {
-        auto pos = std::find (_handlers.begin (), _handlers.end (), handler);
-        if (pos != _handlers.end ())
-            _handlers.erase (pos);
+    template <auto METHOD, typename CONTEXT>
+    bool registerHandler (CONTEXT *context) {
+        return registerDelegate (Delegate::template bind<METHOD> (context));
+    }
+    template <typename CONTEXT>
+    void unregisterHandler (const CONTEXT *context) {
+        size_t count = 0;
+        for (size_t i = 0; i < _count; i++)
+            if (! _handlers [i].template isBoundTo (context))
+                _handlers [count++] = _handlers [i];
+        _count = count;
     }
 
 private:
-    std::vector<Handler *> _handlers;
+    bool registerDelegate (const Delegate &delegate) {
+        if (_count >= CAPACITY) {
+            ALWAYS_DEBUG_PRINTF ("Handlerable: all %u handler slots taken\n", static_cast<unsigned> (CAPACITY));
+            return false;
+        }
+        _handlers [_count++] = delegate;
+        return true;
+    }
+    std::array<Delegate, CAPACITY> _handlers {};
+    size_t _count {};
 
 protected:
     template <typename R = ReturnType>
     typename std::enable_if<std::is_void<R>::value>::type
     notifyHandlers (T t) {
-        for (auto handler : _handlers)
-            handler->handle (t);
+        for (size_t i = 0; i < _count; i++)
+            _handlers [i] (t);
     }
     template <typename R = ReturnType>
     typename std::enable_if<! std::is_void<R>::value, R>::type
     notifyHandlers (T t) {
         R result {};
-        for (auto handler : _handlers)
-            if ((result = handler->handle (t)))
+        for (size_t i = 0; i < _count; i++)
+            if ((result = _handlers [i] (t)))
                 break;
         return result;
     }
@@ -146,6 +205,58 @@ inline String toStringBitwise (T bits) {
     return x;
 }
 
+// -----------------------------------------------------------------------------------------------
+
+#include <atomic>
+
+#ifndef DALYBMS_CACHE_LINE
+#define DALYBMS_CACHE_LINE 64
+#endif
+
+// lock-free single-producer/single-consumer ring: neither side ever waits on the other, a full
+// ring rejects the push (counted) rather than blocking the producer
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert (CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    bool push (const T &item) {
+        const size_t tail = _tail.load (std::memory_order_relaxed);
+        if (tail - _headCached == CAPACITY && tail - (_headCached = _head.load (std::memory_order_acquire)) == CAPACITY) {
+            _overflows.fetch_add (1, std::memory_order_relaxed);
+            return false;
+        }
+        _items [tail & (CAPACITY - 1)] = item;
+        _tail.store (tail + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop (T &item) {
+        const size_t head = _head.load (std::memory_order_relaxed);
+        if (head == _tailCached && head == (_tailCached = _tail.load (std::memory_order_acquire)))
+            return false;
+        item = _items [head & (CAPACITY - 1)];
+        _head.store (head + 1, std::memory_order_release);
+        return true;
+    }
+    size_t size () const {
+        return _tail.load (std::memory_order_acquire) - _head.load (std::memory_order_acquire);
+    }
+    static constexpr size_t capacity () {
+        return CAPACITY;
+    }
+    size_t overflows () const {
+        return _overflows.load (std::memory_order_relaxed);
+    }
+
+private:
+    alignas (DALYBMS_CACHE_LINE) std::atomic<size_t> _tail {};    // producer
+    size_t _headCached {};
+    std::atomic<size_t> _overflows {};
+    alignas (DALYBMS_CACHE_LINE) std::atomic<size_t> _head {};    // consumer
+    size_t _tailCached {};
+    alignas (DALYBMS_CACHE_LINE) std::array<T, CAPACITY> _items {};
+};
+
 // -----------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------
 
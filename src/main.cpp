@@ -38,11 +38,43 @@ public:
 #include "src/DalyBMSRequestResponseTypes.hpp"
 #include "src/DalyBMSManager.hpp"
 #include "src/DalyBMSConnector.hpp"
+#include "src/DalyBMSStore.hpp"
+#include "src/DalyBMSCalibration.hpp"
+#include "src/DalyBMSDiscovery.hpp"
+#include "src/DalyBMSCache.hpp"
+#include "src/DalyBMSPolling.hpp"
+#include "src/DalyBMSRecorder.hpp"
+#include "src/DalyBMSAlarms.hpp"
+#include "src/DalyBMSThresholds.hpp"
+#include "src/DalyBMSRules.hpp"
+#include "src/DalyBMSSnapshot.hpp"
+#include "src/DalyBMSFusion.hpp"
+#include "src/DalyBMSBank.hpp"
+#include "src/DalyBMSFleet.hpp"
+#include "src/DalyBMSConnectorPosix.hpp"
+#include "src/DalyBMSConnectorCan.hpp"
+#include "src/DalyBMSSimulator.hpp"
 #include "src/DalyBMSConverterDebug.hpp"
 #include "src/DalyBMSConverterJson.hpp"
 #include "src/DalyBMSInterface.hpp"
 #else
 #include "DalyBMSInterface.hpp"
+#include "DalyBMSSimulator.hpp"
+#include "DalyBMSStore.hpp"
+#include "DalyBMSCalibration.hpp"
+#include "DalyBMSDiscovery.hpp"
+#include "DalyBMSCache.hpp"
+#include "DalyBMSPolling.hpp"
+#include "DalyBMSRecorder.hpp"
+#include "DalyBMSAlarms.hpp"
+#include "DalyBMSThresholds.hpp"
+#include "DalyBMSRules.hpp"
+#include "DalyBMSSnapshot.hpp"
+#include "DalyBMSFusion.hpp"
+#include "DalyBMSBank.hpp"
+#include "DalyBMSFleet.hpp"
+#include "DalyBMSConnectorPosix.hpp"
+#include "DalyBMSConnectorCan.hpp"
 #endif
 
 // -----------------------------------------------------------------------------------------------
@@ -204,6 +236,945 @@ void testTwo () {
 
 // -----------------------------------------------------------------------------------------------
 
+// a failed check is printed and counted, and dalybms_setup () reports the count once tests have run
+
+static int checksFailed = 0;
+
+bool check (const char *test, const bool condition, const char *claim) {
+    if (! condition) {
+        DEBUG_PRINTF ("%s: CHECK FAILED: %s\n", test, claim);
+        checksFailed++;
+    }
+    return condition;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testDecoding () {
+
+    constexpr int cycles = 1000;
+    const auto measure = [&] (const char *name, const daly_bms::Categories lazy) {
+        const daly_bms::Manager::Config config = {
+            .id = name,
+            .capabilities = daly_bms::Capabilities::All,
+            .categories = daly_bms::Categories::All,
+            .debugging = daly_bms::Debugging::None,
+            .lazy = lazy
+        };
+        daly_bms::Simulator simulator;
+        daly_bms::SimulatorConnector connector (simulator);
+        daly_bms::Manager manager (config, connector);
+        manager.begin ();
+        manager.requestConditions ();    // sizes the diagnostics
+        const unsigned long start = micros ();
+        for (int cycle = 0; cycle < cycles; cycle++) {
+            manager.requestInitial ();
+            manager.requestConditions ();
+            manager.requestDiagnostics ();
+            manager.process ();
+        }
+        const unsigned long polled = micros ();
+        const auto &values = manager.diagnostics.voltages.values;    // read directly, as held before any access
+        const float retained = values.empty () ? 0.0f : values.front ();
+        const bool decoded = manager.conditions.status.decode () && manager.diagnostics.voltages.decode ();
+        const unsigned long accessed = micros ();
+        DEBUG_PRINTF ("decoding<%s>: poll cycle=%luus, first access (status+voltages)=%luus\n", name, (polled - start) / cycles, accessed - polled);
+        if (lazy == daly_bms::Categories::None)
+            check ("decoding", retained > 3.0f, "eager: cell voltages decoded as they arrive");
+        else
+            check ("decoding", retained == 0.0f, "lazy: cell voltages left undecoded until accessed");
+        check ("decoding", decoded && values.size () == simulator.state.cellVoltagesMv.size () && values.back () > 3.0f, "status and every cell voltage decoded on access");
+        manager.end ();
+    };
+
+    measure ("eager", daly_bms::Categories::None);
+    measure ("lazy", daly_bms::Categories::All);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// RAM is per instance (sizeof plus the heap reported during construction); flash is per image, so
+// compare getSketchSize () across builds that each instantiate only one of these configurations
+
+using ManagerOnly = daly_bms::BasicManager<daly_bms::Capabilities::Managing + daly_bms::Capabilities::TemperatureSensing>;
+using BalancerOnly = daly_bms::BasicManager<daly_bms::Capabilities::Balancing + daly_bms::Capabilities::TemperatureSensing>;
+
+void testSizes () {
+
+    const auto measure = [&] (const char *name, auto *type) -> uint32_t {
+        using Type = std::remove_pointer_t<decltype (type)>;
+        const daly_bms::ManagerConfig config = {
+            .id = name,
+            .capabilities = daly_bms::Capabilities::All,
+            .categories = daly_bms::Categories::All,
+            .debugging = daly_bms::Debugging::None
+        };
+        daly_bms::Simulator simulator;
+        daly_bms::SimulatorConnector connector (simulator);
+        const uint32_t heapBefore = ESP.getFreeHeap ();
+        Type *manager = new Type (config, connector);
+        const uint32_t heapAfter = ESP.getFreeHeap ();
+        DEBUG_PRINTF ("sizes<%s>: instance=%u bytes, heap (including instance)=%lu bytes\n", name, sizeof (Type), static_cast<unsigned long> (heapBefore - heapAfter));
+        delete manager;
+        return heapBefore - heapAfter;
+    };
+
+    const uint32_t all = measure ("all", static_cast<daly_bms::Manager *> (nullptr));
+    const uint32_t managerOnly = measure ("manager", static_cast<ManagerOnly *> (nullptr));
+    const uint32_t balancerOnly = measure ("balancer", static_cast<BalancerOnly *> (nullptr));
+    DEBUG_PRINTF ("sizes: sketch=%lu bytes\n", static_cast<unsigned long> (ESP.getSketchSize ()));
+    check ("sizes", sizeof (ManagerOnly) < sizeof (daly_bms::Manager) && sizeof (BalancerOnly) < sizeof (daly_bms::Manager), "fewer capabilities, smaller instances");
+    check ("sizes", managerOnly <= all && balancerOnly <= all, "fewer capabilities, no more heap");
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// the subscription pool is sized at compile time from the responses compiled in: subscribing
+// until it is exhausted fails, reported, and a smaller configuration holds fewer
+
+void testSubscriptions () {
+
+    const auto subscriptions = [&] (auto *type) -> size_t {
+        using Type = std::remove_pointer_t<decltype (type)>;
+        const daly_bms::ManagerConfig config = {
+            .id = "subscriptions",
+            .capabilities = daly_bms::Capabilities::All,
+            .categories = daly_bms::Categories::All,
+            .debugging = daly_bms::Debugging::None
+        };
+        daly_bms::Simulator simulator;
+        daly_bms::SimulatorConnector connector (simulator);
+        Type manager (config, connector);
+        struct Subscriber : daly_bms::Manager::Handler {
+            bool handle (daly_bms::RequestResponse &) override {
+                return true;
+            }
+        } subscriber;
+        size_t subscribed = 0;
+        while (subscribed <= DALYBMS_SUBSCRIBERS * 64 && manager.subscribe (&subscriber, daly_bms::Categories::All))
+            subscribed++;
+        return subscribed;
+    };
+    const size_t subscriptionsAll = subscriptions (static_cast<daly_bms::Manager *> (nullptr)), subscriptionsManagerOnly = subscriptions (static_cast<ManagerOnly *> (nullptr));
+    DEBUG_PRINTF ("subscriptions: all=%u, manager=%u\n", static_cast<unsigned> (subscriptionsAll), static_cast<unsigned> (subscriptionsManagerOnly));
+    check ("subscriptions", subscriptionsAll > DALYBMS_SUBSCRIBERS && subscriptionsAll <= DALYBMS_SUBSCRIBERS * 64, "the subscription pool is bounded and reports exhaustion");
+    check ("subscriptions", subscriptionsManagerOnly < subscriptionsAll, "fewer responses compiled in, smaller subscription pool");
+
+    // a handler that is not the first base: subscribed by its Handler subobject, unsubscribed by itself
+    struct Named {
+        virtual ~Named () = default;
+        const char *name = "counter";
+    };
+    struct Counter : Named, daly_bms::Manager::Handler {
+        int handled = 0;
+        bool handle (daly_bms::RequestResponse &) override {
+            handled++;
+            return true;
+        }
+        bool method (daly_bms::RequestResponse &) {
+            handled++;
+            return true;
+        }
+    } counter, methodCounter;
+    const daly_bms::ManagerConfig config = {
+        .id = "subscriptions",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator);
+    daly_bms::Manager manager (config, connector);
+    manager.subscribe (&counter, daly_bms::Categories::Conditions);
+    manager.subscribe<&Counter::method> (&methodCounter, manager.conditions.status);
+    manager.begin ();
+    manager.requestConditions ();
+    manager.process ();
+    const int handled = counter.handled, methodHandled = methodCounter.handled;
+    manager.unsubscribe (&counter);
+    manager.unsubscribe (&methodCounter);
+    manager.requestConditions ();
+    manager.process ();
+    check ("subscriptions", handled > 0 && methodHandled > 0, "a handler and a method behind another base were notified");
+    check ("subscriptions", counter.handled == handled && methodCounter.handled == methodHandled, "unsubscribing by the object removed both");
+    check ("subscriptions", static_cast<const void *> (&counter) != static_cast<const daly_bms::Manager::Handler *> (&counter), "the Handler subobject is not where the object starts");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// startup burst into a 256 byte receive buffer at 9600 baud, serviced once a second as by
+// processInterval: without credit the buffer overflows, with it nothing is dropped
+
+void testFlowControl () {
+
+    const auto measure = [&] (const char *name, const size_t credit) {
+        const daly_bms::ManagerConfig config = {
+            .id = name,
+            .capabilities = daly_bms::Capabilities::All,
+            .categories = daly_bms::Categories::All,
+            .debugging = daly_bms::Debugging::None,
+            .creditRx = credit
+        };
+        daly_bms::Simulator simulator;
+        daly_bms::SimulatorConnector connector (simulator, { .bufferRx = 256, .turnaroundUs = 5000, .byteUs = 1042 });
+        daly_bms::Manager manager (config, connector);
+        manager.begin ();
+        const unsigned long start = millis ();
+        const auto settle = [&] () {
+            do {
+                delay (1000);
+                manager.process ();
+            } while (! manager.isIdle () && millis () - start < 15000);
+        };
+        manager.requestInitial ();
+        manager.requestConditions ();
+        settle ();
+        manager.requestDiagnostics ();
+        settle ();
+        DEBUG_PRINTF ("flowcontrol<%s>: dropped=%u bytes, received=%lu, held=%lu, timeouts=%lu, voltages=%s, time=%lums\n", name, static_cast<unsigned> (connector.dropped ()),
+                      manager.getStatus ().received.count (), manager.getStatus ().held.count (), manager.getStatus ().timeouts.count (), manager.diagnostics.voltages.isValid () ? "valid" : "invalid", millis () - start);
+        if (credit == 0)
+            check ("flowcontrol", connector.dropped () > 0, "uncredited: the receive buffer overflows");
+        else
+            check ("flowcontrol", connector.dropped () == 0 && manager.getStatus ().held.count () > 0 && manager.diagnostics.voltages.isValid (), "credited: requests held back, nothing dropped, cell voltages arrive");
+        manager.end ();
+    };
+
+    measure ("uncredited", 0);
+    measure ("credited", 256);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// calibration against a simulated device that ignores requests arriving within 15ms of the
+// previous one, or while two are already awaiting answer
+
+void testCalibration () {
+
+    const daly_bms::ManagerConfig config = {
+        .id = "calibration",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042, .recoveryUs = 15000, .queueDepth = 2 });
+    daly_bms::Manager manager (config, connector);
+    manager.begin ();
+
+    daly_bms::Calibration<daly_bms::Manager> calibration (manager);
+    const daly_bms::Calibration<daly_bms::Manager>::Config calibrationConfig;
+    size_t unsafe = 0;
+    for (const auto &measurement : calibration.sweep (calibrationConfig)) {
+        DEBUG_PRINTF ("calibration: gap=%lums depth=%u: sent=%lu, lost=%lu, latency=%lums, rate=%.1f/s%s\n", static_cast<unsigned long> (measurement.pacing.gap), static_cast<unsigned> (measurement.pacing.depth),
+                      static_cast<unsigned long> (measurement.sent), static_cast<unsigned long> (measurement.lost), static_cast<unsigned long> (measurement.latencyMean), measurement.rate (), measurement.safe () ? "" : " (unsafe)");
+        unsafe += measurement.safe () ? 0 : 1;
+    }
+    check ("calibration", unsafe > 0, "the sweep finds settings the device cannot keep up with");
+    daly_bms::Calibration<daly_bms::Manager>::Measurement chosen;
+    const bool calibrated = calibration.calibrate (calibrationConfig, &chosen);
+    if (calibrated)
+        DEBUG_PRINTF ("calibration: chosen gap=%lums depth=%u, rate=%.1f/s, device ignored=%u\n", static_cast<unsigned long> (chosen.pacing.gap), static_cast<unsigned> (chosen.pacing.depth), chosen.rate (), static_cast<unsigned> (connector.ignored ()));
+    check ("calibration", calibrated && chosen.safe () && chosen.pacing.gap >= 15, "the chosen setting lost nothing and respects the device's recovery time");
+    check ("calibration", manager.getPacing ().gap == chosen.pacing.gap && manager.getPacing ().depth == chosen.pacing.depth, "the chosen setting is applied to the manager");
+    manager.end ();
+
+    // the first boot calibrates (over fewer settings, for time) and stores, the next restores
+    daly_bms::MemoryStore store;
+    daly_bms::Calibration<daly_bms::Manager>::Config storedConfig;
+    storedConfig.gaps = { 40, 20 };
+    storedConfig.depths = { 1 };
+    const auto boot = [&] (daly_bms::Manager::Pacing &pacing, bool &restored, counter_t &sent) {
+        daly_bms::SimulatorConnector bootConnector (simulator, { .turnaroundUs = 5000, .byteUs = 1042, .recoveryUs = 15000, .queueDepth = 2 });
+        daly_bms::Manager bootManager (config, bootConnector);
+        bootManager.begin ();
+        daly_bms::Calibration<daly_bms::Manager> bootCalibration (bootManager);
+        const bool begun = bootCalibration.begin (store, storedConfig);
+        pacing = bootManager.getPacing ();
+        restored = bootCalibration.isRestored ();
+        sent = bootManager.getStatus ().sent.count ();
+        bootManager.end ();
+        return begun;
+    };
+    daly_bms::Manager::Pacing firstPacing, secondPacing;
+    bool firstRestored = true, secondRestored = false;
+    counter_t firstSent = 0, secondSent = 0;
+    const bool firstBegun = boot (firstPacing, firstRestored, firstSent), secondBegun = boot (secondPacing, secondRestored, secondSent);
+    DEBUG_PRINTF ("calibration: first boot gap=%lums depth=%u sent=%lu, second boot gap=%lums depth=%u sent=%lu%s\n", static_cast<unsigned long> (firstPacing.gap), static_cast<unsigned> (firstPacing.depth), static_cast<unsigned long> (firstSent),
+                  static_cast<unsigned long> (secondPacing.gap), static_cast<unsigned> (secondPacing.depth), static_cast<unsigned long> (secondSent), secondRestored ? " (restored)" : "");
+    check ("calibration", firstBegun && ! firstRestored && firstSent > 0, "the first boot calibrated");
+    check ("calibration", secondBegun && secondRestored && secondSent == 0, "the next boot restored the setting without sweeping");
+    check ("calibration", secondPacing.gap == firstPacing.gap && secondPacing.depth == firstPacing.depth, "the restored setting is the one calibrated");
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testDiscovery () {
+
+    const daly_bms::ManagerConfig config = {
+        .id = "discovery",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::MemoryStore store;
+    uint32_t probed = 0;
+    for (int boot = 0; boot < 2; boot++) {    // the second boot restores what the first probed
+        daly_bms::Simulator simulator;
+        simulator.state.unanswered = { 0x5A, 0x5B, 0x5E, 0x92, 0x96, 0x97 };
+        daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 2000, .byteUs = 1042 });
+        daly_bms::Manager manager (config, connector);
+        manager.begin ();
+        daly_bms::Discovery<daly_bms::Manager> discovery (manager, connector);
+        const unsigned long started = millis ();
+        const bool discovered = discovery.begin (store);
+        DEBUG_PRINTF ("discovery: boot %d: %s, %s in %lums, responding=%08lx, capabilities=%s\n", boot, discovered ? "succeeded" : "failed", discovery.isRestored () ? "restored" : "probed", millis () - started,
+                      static_cast<unsigned long> (discovery.getProfile ().responding), daly_bms::toStringBitwise (discovery.capabilities ()).c_str ());
+        if (boot == 0)
+            probed = discovery.getProfile ().responding;
+        check ("discovery", discovered && discovery.isRestored () == (boot == 1), boot == 0 ? "probed on the first boot" : "restored on the second boot");
+        check ("discovery", discovery.getProfile ().responding == probed, "the restored profile is the one probed");
+        check ("discovery", manager.isEnabled (&manager.conditions.status) && ! manager.isEnabled (&manager.conditions.sensor), "what answers (0x90) is enabled, what does not (0x92) is not");
+        manager.end ();
+    }
+
+    // a device whose hardware string takes other than the usual frames is identified only after
+    // probing, and only from the stored frames on later boots
+    daly_bms::MemoryStore storeLonger;
+    for (int boot = 0; boot < 2; boot++) {
+        daly_bms::Simulator simulator;
+        simulator.state.hardware = "DL-SIMULATOR-HW-0001-LONGER";
+        simulator.state.hardwareFrames = 4;
+        daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 2000, .byteUs = 1042 });
+        daly_bms::Manager manager (config, connector);
+        manager.begin ();
+        daly_bms::Discovery<daly_bms::Manager> discovery (manager, connector);
+        const bool discovered = discovery.begin (storeLonger);
+        DEBUG_PRINTF ("discovery: longer identity, boot %d: %s, %s, hardware='%s'\n", boot, discovered ? "succeeded" : "failed", discovery.isRestored () ? "restored" : "probed", manager.information.hardware.string.c_str ());
+        check ("discovery", discovered && discovery.isRestored () == (boot == 1), boot == 0 ? "a longer identity probed on the first boot" : "a longer identity restored on the second boot");
+        check ("discovery", manager.information.hardware.getResponseFrameCount () == 4 && manager.information.hardware.string.startsWith ("DL-SIMULATOR-HW-0001-LONGER"), "the longer identity string was read whole");
+        manager.end ();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testCache () {
+
+    const daly_bms::ManagerConfig config = {
+        .id = "cache",
+        .capabilities = daly_bms::Capabilities::All,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::MemoryStore store;
+    for (int boot = 0; boot < 3; boot++) {    // cold, then restored, then restored but for another device
+        daly_bms::Simulator simulator;
+        if (boot == 2)
+            simulator.state.hardware = "DL-REPLACED-HW";
+        daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+        daly_bms::Manager manager (config, connector);
+        daly_bms::Cache<daly_bms::Manager> cache (manager, connector);
+        manager.begin ();
+        const unsigned long started = millis ();
+        const bool restored = cache.begin (store);
+        if (! restored)
+            manager.requestInitial ();
+        check ("cache", restored == (boot > 0), boot == 0 ? "nothing restored when cold" : "restored from the previous boot");
+        if (restored)
+            check ("cache", manager.thresholds.voltage.isValid () && cache.isStale (manager.thresholds.voltage), "restored responses are valid at once, but stale");
+        manager.requestConditions ();
+        unsigned long status = 0;
+        while (millis () - started < 5000) {
+            manager.process ();
+            cache.process ();
+            if (status == 0 && manager.conditions.status.decode ())
+                status = millis () - started;
+            delay (1);
+        }
+        DEBUG_PRINTF ("cache: boot %d: restored=%u, first status after %lums, stale=%u, hardware=%s\n", boot, static_cast<unsigned> (cache.restored ()), status, static_cast<unsigned> (cache.stale ()), manager.information.hardware.string.c_str ());
+        check ("cache", cache.stale () == 0 && manager.thresholds.voltage.isValid (), "every restored response revalidated");
+        check ("cache", manager.information.hardware.string.startsWith (boot == 2 ? "DL-REPLACED" : "DL-SIMULATOR"), "the identity is the device's own, not the stored one");
+        manager.end ();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testStartup () {
+
+    const daly_bms::ManagerConfig config = {
+        .id = "startup",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    unsigned long firstStatus [2] = {};
+    for (int planned = 0; planned < 2; planned++) {    // as Interface::begin () used to, then planned
+        daly_bms::Simulator simulator;
+        daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 20000, .byteUs = 1042 });
+        daly_bms::Manager manager (config, connector);
+        manager.begin ();
+        const unsigned long started = millis ();
+        if (planned)
+            manager.requestStartup ();
+        else {
+            manager.requestInitial ();
+            manager.requestConditions ();
+        }
+        unsigned long status = 0;
+        while (millis () - started < 5000) {
+            manager.process ();
+            if (status == 0 && manager.conditions.status.decode ())
+                status = millis () - started;
+            delay (1);
+        }
+        DEBUG_PRINTF ("startup: %s: first status after %lums (metric %lums), full state after %lums\n", planned ? "planned" : "unplanned", status, static_cast<unsigned long> (manager.getStatus ().startupStatus), static_cast<unsigned long> (manager.getStatus ().startupFull));
+        firstStatus [planned] = status;
+        if (planned)
+            check ("startup", manager.getStatus ().startupFull > 0 && manager.diagnostics.voltages.isValid () && manager.information.hardware.isValid (), "planned: the full state, static information included, still arrives");
+        manager.end ();
+    }
+    check ("startup", firstStatus [1] > 0 && firstStatus [1] < firstStatus [0], "planned: the first status arrives sooner");
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testFreshness () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "freshness",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 2000;
+    config.ttl.commands = { { 0x90, 1000 } };    // status, more often
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    manager.begin ();
+    check ("freshness", manager.conditions.status.getTimeToLive () == 1000 && manager.conditions.voltage.getTimeToLive () == 2000, "times to live by command, then by category");
+    manager.requestConditions ();    // once only: refresh keeps them fresh from here on
+    const unsigned long started = millis ();
+    for (const unsigned long until : { 6000, 10000 }) {
+        while (millis () - started < until) {
+            manager.process ();
+            delay (1);
+        }
+        DEBUG_PRINTF ("freshness: after %lums: status %s, age %lums, refreshed=%lu, timeouts=%lu\n", until, manager.conditions.status.isFresh () ? "fresh" : "stale",
+                      static_cast<unsigned long> (manager.conditions.status.age ()), static_cast<unsigned long> (manager.getStatus ().refreshed.count ()), static_cast<unsigned long> (manager.getStatus ().timeouts.count ()));
+        if (until == 6000)
+            check ("freshness", manager.conditions.status.isFresh () && manager.getStatus ().refreshed.count () > 0, "kept fresh by refresh alone, well past the time to live");
+        else
+            check ("freshness", ! manager.conditions.status.isFresh () && manager.conditions.status.isValid (), "stale, though still valid, once the device is silent");
+        simulator.state.unanswered = { 0x90, 0x91, 0x92, 0x93, 0x94, 0x98 };    // then the device goes silent
+    }
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testPolling () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "polling",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    daly_bms::AdaptivePolling<daly_bms::Manager> polling (manager, connector);
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = millis ();
+    unsigned long stepped = started;
+    while (millis () - started < 60000) {    // idle for half, then charging hard with cells rising 1mV/s
+        manager.process ();
+        if (millis () - started > 30000 && millis () - stepped >= 1000) {
+            simulator.state.state = 0x01;
+            simulator.state.currentA = 20.0f;
+            for (auto &voltage : simulator.state.cellVoltagesMv)
+                voltage++;
+            stepped = millis ();
+        }
+        delay (1);
+    }
+    for (const auto state : { daly_bms::ChargeState::Stationary, daly_bms::ChargeState::Charge }) {
+        const auto &regime = polling.regime (state);
+        DEBUG_PRINTF ("polling: %s: %lums, bus %.2f%%, status every %lums, voltages every %lums\n", daly_bms::toString (state).c_str (), static_cast<unsigned long> (regime.duration), 100.0f * regime.utilisation (polling.baud ()),
+                      static_cast<unsigned long> (regime.statusInterval ()), static_cast<unsigned long> (regime.voltagesInterval ()));
+    }
+    const auto &stationary = polling.regime (daly_bms::ChargeState::Stationary), &charging = polling.regime (daly_bms::ChargeState::Charge);
+    check ("polling", charging.statusInterval () > 0 && charging.statusInterval () < stationary.statusInterval () && charging.voltagesInterval () < stationary.voltagesInterval (), "status and cell voltages polled more often while charging");
+    check ("polling", stationary.utilisation (polling.baud ()) < charging.utilisation (polling.baud ()), "the bus is left quieter while stationary");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testRecorder () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "recorder",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 2000;
+    config.ttl.diagnostics = 5000;
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    daly_bms::FlightRecorder<daly_bms::Manager, 256> recorder (manager, connector, { .pre = 10000, .post = 5000 });
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = millis ();
+    while (recorder.state () != decltype (recorder)::State::Frozen && millis () - started < 30000) {
+        manager.process ();
+        recorder.process ();
+        if (millis () - started > 15000)
+            simulator.state.failures = 0x01;    // cell voltage high level 1
+        delay (1);
+    }
+    std::vector<uint8_t> capture;
+    recorder.exportCapture ([&] (const uint8_t *data, const size_t size) {
+        capture.insert (capture.end (), data, data + size);
+    });
+    size_t before = 0, after = 0;    // by each record's time relative to the trigger, after the 8 byte header
+    constexpr size_t record = 4 + daly_bms::RequestResponseFrame::size ();
+    for (size_t offset = 8; offset + record <= capture.size (); offset += record) {
+        const int32_t relative = static_cast<int32_t> (capture [offset] | (capture [offset + 1] << 8) | (capture [offset + 2] << 16) | (static_cast<uint32_t> (capture [offset + 3]) << 24));
+        relative < 0 ? before++ : after++;
+    }
+    const bool frozen = recorder.state () == decltype (recorder)::State::Frozen;
+    DEBUG_PRINTF ("recorder: %s, %u frames (%u before, %u after), %u bytes captured, %lu requests sent\n", frozen ? "frozen" : "not triggered", static_cast<unsigned> (recorder.frames ()), static_cast<unsigned> (before), static_cast<unsigned> (after), static_cast<unsigned> (capture.size ()), static_cast<unsigned long> (manager.getStatus ().sent.count ()));
+    check ("recorder", frozen && recorder.reason () == decltype (recorder)::Trigger::Failure, "frozen by the new failure");
+    check ("recorder", before > 0 && after > 0 && before + after == recorder.frames (), "the capture holds frames from before and after the trigger");
+    check ("recorder", after * 10000 > before * 5000, "frames arrive faster after the trigger, as polling is boosted");
+    check ("recorder", ! manager.conditions.status.isTimeToLiveOverridden (), "the boost ends once frozen");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testAlarms () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "alarms",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 500;
+    daly_bms::MemoryStore store;
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    daly_bms::AlarmJournal<daly_bms::Manager> journal (manager, { .raise = 2, .clear = 2000 });
+    journal.begin (store);
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = millis ();
+    while (millis () - started < 12000) {    // a glitch (not raised), a steady alarm, and a flickering one (raised once)
+        const unsigned long elapsed = millis () - started;
+        simulator.state.failures = (elapsed > 2000 && elapsed < 2300) ? 0x02 : (elapsed > 3000 && elapsed < 9000) ? ((elapsed / 700) % 2 ? 0x101 : 0x100) : 0;
+        manager.process ();
+        journal.process ();
+        delay (1);
+    }
+    std::vector<daly_bms::AlarmEvent> events;
+    journal.query ([&] (const daly_bms::AlarmEvent &event) {
+        DEBUG_PRINTF ("alarms: %lu: %s %s\n", static_cast<unsigned long> (event.time), event.description (), event.kind == daly_bms::AlarmEvent::Kind::Raised ? "raised" : "cleared");
+        events.push_back (event);
+    });
+    const auto sequence = [&] (const uint8_t code) {
+        std::vector<daly_bms::AlarmEvent::Kind> kinds;
+        for (const auto &event : events)
+            if (event.code == code)
+                kinds.push_back (event.kind);
+        return kinds;
+    };
+    const std::vector<daly_bms::AlarmEvent::Kind> raisedThenCleared { daly_bms::AlarmEvent::Kind::Raised, daly_bms::AlarmEvent::Kind::Cleared };
+    check ("alarms", sequence (1).empty (), "the glitch (bit 1) is not raised");
+    check ("alarms", sequence (8) == raisedThenCleared, "the steady alarm (bit 8) is raised, then cleared");
+    check ("alarms", sequence (0) == raisedThenCleared, "the flickering alarm (bit 0) is raised once, then cleared");
+    daly_bms::AlarmJournal<daly_bms::Manager> restored (manager);
+    check ("alarms", restored.begin (store) && restored.size () == events.size (), "the journal is restored from the store");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testThresholds () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "thresholds",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 1000;
+    config.ttl.diagnostics = 1000;
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    daly_bms::ThresholdMonitor<daly_bms::Manager> monitor (manager, { .horizon = 30.0f });
+    class Reporter : public daly_bms::ThresholdMonitor<daly_bms::Manager>::Handler {
+    public:
+        unsigned long started {}, approached {}, reached {};
+        float projected {};
+        void handle (const daly_bms::ThresholdEvent &event) override {
+            DEBUG_PRINTF ("thresholds: %lums: %s %s %s, value=%.3f, limit=%.3f, in %.1fs\n", millis () - started, daly_bms::ThresholdEvent::getQuantityName (event.quantity), event.bound == daly_bms::ThresholdEvent::Bound::High ? "high" : "low", daly_bms::ThresholdEvent::getLevelName (event.level), event.value, event.limit, event.seconds);
+            if (event.quantity != daly_bms::ThresholdEvent::Quantity::CellVoltage || event.bound != daly_bms::ThresholdEvent::Bound::High)
+                return;
+            if (event.level == daly_bms::ThresholdEvent::Level::Approaching && approached == 0)
+                approached = millis () - started, projected = event.seconds;
+            if (event.level == daly_bms::ThresholdEvent::Level::L1 && reached == 0)
+                reached = millis () - started;
+        }
+    } reporter;
+    monitor.registerHandler (&reporter);
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = reporter.started = millis ();
+    simulator.state.state = 1;
+    while (millis () - started < 40000) {    // one cell charging at 20mV/s towards the 3.65V L1 limit, ahead of any failure bit
+        simulator.state.cellVoltagesMv [3] = static_cast<uint16_t> (3300 + (millis () - started) / 50);
+        manager.process ();
+        delay (1);
+    }
+    check ("thresholds", reporter.approached > 0 && reporter.reached > reporter.approached, "the cell is reported approaching its high limit before reaching it");
+    check ("thresholds", reporter.projected > 0.0f && reporter.projected <= 30.0f, "the approach is projected within the horizon");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testRules () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "rules",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 500;
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    daly_bms::RuleEngine<daly_bms::Manager> rules (manager);
+    rules.add ("imbalance", "cell delta > 30 mV for 3 s while charging");
+    rules.add ("hot", "sensor max > 45 °C and current > 50 A");
+    check ("rules", rules.add ("broken", "cell delta > and current") < 0 && rules.error () != nullptr && rules.size () == 2, "a malformed rule is rejected, leaving the others");
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = millis ();
+    unsigned long activated [2] = {};
+    while (millis () - started < 10000) {    // charging from 1s, one cell high from 2s, hot under load from 6s
+        const unsigned long elapsed = millis () - started;
+        simulator.state.state = elapsed > 1000 ? 1 : 0;
+        simulator.state.cellVoltagesMv [2] = elapsed > 2000 ? 3350 : 3300;
+        simulator.state.sensorTemperaturesC [0] = elapsed > 6000 ? 50 : 25;
+        simulator.state.currentA = elapsed > 6000 ? 60.0f : 0.0f;
+        manager.process ();
+        rules.process ();
+        for (size_t index = 0; index < 2; index++)
+            if (activated [index] == 0 && rules.isActive (index))
+                activated [index] = elapsed;
+        delay (1);
+    }
+    for (size_t index = 0; index < rules.size (); index++)
+        DEBUG_PRINTF ("rules: '%s' %s after %lums\n", rules.name (index), rules.isActive (index) ? "active" : "inactive", activated [index]);
+    check ("rules", activated [0] >= 5000 && rules.isActive (0), "the imbalance is active only once held for 3s after it starts at 2s");
+    check ("rules", activated [1] >= 6000 && rules.isActive (1), "the hot rule is active only once both its conditions hold");
+
+    daly_bms::RuleEngine<daly_bms::Manager> bench (manager);    // evaluation rate, over the values now held
+    char text [96];
+    for (int i = 0; i < 500; i++) {
+        snprintf (text, sizeof (text), "cell delta > %d mV for %d s while charging or sensor max > %d and current > %d A", 10 + i % 50, i % 120, 30 + i % 20, i % 100);
+        bench.add ("bench", text);
+    }
+    const unsigned long benched = micros ();
+    size_t evaluated = 0;
+    while (micros () - benched < 1000000)
+        evaluated += bench.evaluateAll ();
+    DEBUG_PRINTF ("rules: %u rules of %u instructions, %.0f rules/s\n", static_cast<unsigned> (bench.size ()), static_cast<unsigned> (bench.instructions ()), evaluated * 1000000.0 / (micros () - benched));
+    check ("rules", bench.size () == 500 && evaluated > 0, "every benchmark rule compiles and runs");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testSnapshot () {
+
+    daly_bms::ManagerConfig configManager = {
+        .id = "manager",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::ManagerConfig configBalance = configManager;
+    configBalance.id = "balance";
+    daly_bms::Simulator simulatorManager, simulatorBalance;
+    daly_bms::SimulatorConnector connectorManager (simulatorManager, { .turnaroundUs = 5000, .byteUs = 1042 }), connectorBalance (simulatorBalance, { .turnaroundUs = 15000, .byteUs = 1042 });
+    daly_bms::Manager manager (configManager, connectorManager), balance (configBalance, connectorBalance);
+    daly_bms::SnapshotBarrier<daly_bms::Manager> barrier ({ &manager, &balance }, { .sources = { { 0, 0x90 }, { 0, 0x95 }, { 1, 0x95 } }, .timeout = 1000 });
+    class Reporter : public daly_bms::SnapshotBarrier<daly_bms::Manager>::Handler {
+    public:
+        size_t complete {}, incomplete {}, completeAfterIncomplete {};
+        daly_bms::SystemTicks_t skewMax {};
+        void handle (const daly_bms::Snapshot &snapshot) override {
+            DEBUG_PRINTF ("snapshot: %lu %s, skew=%lums, spread=%lums\n", static_cast<unsigned long> (snapshot.sequence), snapshot.complete ? "complete" : "incomplete", static_cast<unsigned long> (snapshot.skew), static_cast<unsigned long> (snapshot.spread));
+            if (snapshot.complete) {
+                complete++;
+                completeAfterIncomplete += incomplete > 0 ? 1 : 0;
+                skewMax = std::max (skewMax, snapshot.skew);
+            } else
+                incomplete++;
+        }
+    } reporter;
+    barrier.registerHandler (&reporter);
+    manager.begin ();
+    balance.begin ();
+    manager.requestStartup ();
+    balance.requestStartup ();
+    const unsigned long started = millis ();
+    unsigned long captured = 0;
+    while (millis () - started < 7500) {    // the balancer stops answering cell voltages at 4s
+        if (millis () - captured >= 1000) {
+            captured = millis ();
+            barrier.capture ();
+        }
+        simulatorBalance.state.unanswered = (millis () - started > 4000) ? std::vector<uint8_t> { 0x95 } : std::vector<uint8_t> {};
+        manager.process ();
+        balance.process ();
+        barrier.process ();
+        delay (1);
+    }
+    const auto &stats = barrier.stats ();
+    DEBUG_PRINTF ("snapshot: %lu captures, %lu incomplete, skew mean=%lums max=%lums\n", static_cast<unsigned long> (stats.captures), static_cast<unsigned long> (stats.incomplete), static_cast<unsigned long> (stats.skewMean ()), static_cast<unsigned long> (stats.skewMax));
+    check ("snapshot", reporter.complete > 0 && reporter.incomplete > 0 && reporter.completeAfterIncomplete == 0, "complete while the balancer answers, incomplete once it does not");
+    check ("snapshot", reporter.skewMax < 1000 && stats.captures == reporter.complete + reporter.incomplete, "complete snapshots fall within the timeout, and every capture is reported");
+    manager.end ();
+    balance.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testFusion () {
+
+    daly_bms::ManagerConfig configManager = {
+        .id = "manager",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    configManager.ttl.refresh = true;
+    daly_bms::ManagerConfig configBalance = configManager;
+    configBalance.id = "balance";
+    daly_bms::Simulator simulatorManager, simulatorBalance;
+    daly_bms::SimulatorConnector connectorManager (simulatorManager, { .turnaroundUs = 5000, .byteUs = 1042 }), connectorBalance (simulatorBalance, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (configManager, connectorManager), balance (configBalance, connectorBalance);
+    daly_bms::CellFusion<daly_bms::Manager> fusion ({ &manager, &balance }, { .maximum = 3000, .tolerance = 0.010f, .interleave = 1000 });
+    manager.begin ();
+    balance.begin ();
+    manager.requestStartup ();
+    balance.requestStartup ();
+    const unsigned long started = millis ();
+    unsigned long shown = 0;
+    bool bothSources = false, disagreedInside = false, disagreedOutside = false;
+    while (millis () - started < 12000) {    // cell 6 rising, cell 8 misread by the balancer from 3s to 5s, the balancer quiet from 7s
+        const unsigned long elapsed = millis () - started;
+        simulatorManager.state.cellVoltagesMv [5] = simulatorBalance.state.cellVoltagesMv [5] = static_cast<uint16_t> (3300 + elapsed / 100);
+        simulatorBalance.state.cellVoltagesMv [7] = (elapsed > 3000 && elapsed < 5000) ? 3340 : 3300;
+        simulatorBalance.state.unanswered = elapsed > 7000 ? std::vector<uint8_t> { 0x95, 0x91 } : std::vector<uint8_t> {};
+        manager.process ();
+        balance.process ();
+        fusion.process ();
+        delay (1);
+        const auto rising = fusion.cell (5), misread = fusion.cell (7);
+        if (elapsed > 2000 && elapsed < 6000)
+            bothSources = bothSources || rising.sources == 0x3;
+        if (elapsed > 3500 && elapsed < 5000)
+            disagreedInside = disagreedInside || misread.disagree;
+        if (elapsed > 6500)
+            disagreedOutside = disagreedOutside || misread.disagree;
+        if (elapsed - shown >= 1000) {
+            shown = elapsed;
+            DEBUG_PRINTF ("fusion: %lums: cell 6 %.3fV, age %lums, sources %x; cell 8 %.3fV%s\n", elapsed, rising.voltage, static_cast<unsigned long> (rising.age), rising.sources, misread.voltage, misread.disagree ? ", disagree" : "");
+        }
+    }
+    const auto rising = fusion.cell (5);
+    check ("fusion", bothSources, "the cell is fused from both ports while both answer");
+    check ("fusion", disagreedInside && ! disagreedOutside, "the misread cell is flagged while misread, and only then");
+    check ("fusion", rising.sources == 0x1 && ! rising.stale && std::fabs (rising.voltage - 3.410f) < 0.020f, "the quiet balancer drops out, the manager's reading carries on");
+    manager.end ();
+    balance.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testBank () {
+
+    daly_bms::ManagerConfig config = {
+        .id = "manager",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    config.ttl.refresh = true;
+    config.ttl.conditions = 500;
+    std::array<daly_bms::Simulator, 3> simulators;
+    std::vector<std::unique_ptr<daly_bms::SimulatorConnector>> connectors;
+    std::vector<std::unique_ptr<daly_bms::Manager>> managers;
+    for (auto &simulator : simulators) {
+        connectors.push_back (std::make_unique<daly_bms::SimulatorConnector> (simulator, daly_bms::SimulatorConnector::Line { .turnaroundUs = 5000, .byteUs = 1042 }));
+        managers.push_back (std::make_unique<daly_bms::Manager> (config, *connectors.back ()));
+    }
+    simulators [0].state.currentA = 10.0f, simulators [0].state.chargePercent = 50.0f;
+    simulators [1].state.currentA = 20.0f, simulators [1].state.chargePercent = 80.0f, simulators [1].state.packCapacityMah = 200000;
+    simulators [1].state.cellVoltagesMv [4] = 3400;
+    simulators [2].state.cellVoltagesMv [9] = 3450;    // the balancer of the first pack
+    daly_bms::Bank<daly_bms::Manager> bank ({ { managers [0].get (), managers [2].get () }, { managers [1].get () } });
+    for (auto &manager : managers) {
+        manager->begin ();
+        manager->requestStartup ();
+    }
+    const auto &aggregates = bank.aggregates ();
+    const auto run = [&] (const unsigned long duration, const auto &step) {
+        const unsigned long started = millis ();
+        while (millis () - started < duration) {
+            step (millis () - started);
+            for (auto &manager : managers)
+                manager->process ();
+            bank.process ();
+            delay (1);
+        }
+        DEBUG_PRINTF ("bank: %u packs, %u reporting, current=%.1fA, charge=%.1f%%, capacity=%.0fAh, max=%.3fV (pack %u cell %u), min=%.3fV (pack %u cell %u), failures=%llx in %u packs\n", static_cast<unsigned> (bank.size ()), static_cast<unsigned> (aggregates.reporting), aggregates.current, aggregates.charge, aggregates.capacity, aggregates.cellMax.voltage, static_cast<unsigned> (aggregates.cellMax.pack), aggregates.cellMax.cell, aggregates.cellMin.voltage, static_cast<unsigned> (aggregates.cellMin.pack), aggregates.cellMin.cell, static_cast<unsigned long long> (aggregates.failures), static_cast<unsigned> (aggregates.failing));
+    };
+
+    run (1500, [] (unsigned long) { });
+    check ("bank", bank.size () == 2 && aggregates.reporting == 2 && std::fabs (aggregates.current - 30.0f) < 0.05f, "two packs reporting, their currents summed");
+    check ("bank", std::fabs (aggregates.capacity - 300.0f) < 0.5f && std::fabs (aggregates.charge - 70.0f) < 0.5f, "charge weighted by capacity");
+    check ("bank", aggregates.cellMax.pack == 0 && aggregates.cellMax.cell == 10 && std::fabs (aggregates.cellMax.voltage - 3.450f) < 0.0005f, "the highest cell found through the first pack's balancer");
+    run (2500, [&] (unsigned long) {    // the highest cell settles, so the next highest is found
+        simulators [2].state.cellVoltagesMv [9] = 3300, simulators [1].state.failures = 0x05;
+    });
+    check ("bank", aggregates.cellMax.pack == 1 && aggregates.cellMax.cell == 5 && std::fabs (aggregates.cellMax.voltage - 3.400f) < 0.0005f, "the next highest cell found once the highest settles");
+    check ("bank", aggregates.failures == 0x05 && aggregates.failing == 1, "failures combined by code, counted by pack");
+    run (3000, [&] (unsigned long) {    // the second pack falls silent
+        simulators [1].state.unanswered = { 0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98 };
+    });
+    check ("bank", aggregates.reporting == 1 && std::fabs (aggregates.current - 10.0f) < 0.05f && aggregates.failing == 0, "the silent pack drops out of the aggregates");
+    for (auto &manager : managers)
+        manager->end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void testFleet () {
+
+    using Fleet = daly_bms::FleetStore<daly_bms::Manager>;
+    daly_bms::ManagerConfig config = {
+        .id = "pack",
+        .capabilities = daly_bms::Capabilities::All - daly_bms::Capabilities::FirmwareIndex,
+        .categories = daly_bms::Categories::All,
+        .debugging = daly_bms::Debugging::None
+    };
+    daly_bms::Simulator simulator;
+    daly_bms::SimulatorConnector connector (simulator, { .turnaroundUs = 5000, .byteUs = 1042 });
+    daly_bms::Manager manager (config, connector);
+    simulator.state.cellVoltagesMv [3] = 3500;
+    simulator.state.sensorTemperaturesC [0] = 47;
+    Fleet fleet (1000, 16);
+    fleet.attach (0, manager);    // one pack from its manager, the others synthesised
+    manager.begin ();
+    manager.requestStartup ();
+    const unsigned long started = millis ();
+    while (millis () - started < 1500) {
+        manager.process ();
+        delay (1);
+    }
+    uint32_t seed = 1;
+    const auto random = [&seed] () {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7FFF;
+    };
+    for (size_t pack = 1; pack < fleet.packs (); pack++) {
+        std::array<float, 16> cells;
+        for (auto &cell : cells)
+            cell = 3.2f + static_cast<float> (random () % 200) / 1000.0f;
+        const auto [minimum, maximum] = std::minmax_element (cells.begin (), cells.end ());
+        fleet.updateCells (pack, cells.data (), cells.size ());
+        fleet.update (pack, Fleet::Column::CellMax, *maximum);
+        fleet.update (pack, Fleet::Column::CellMin, *minimum);
+        fleet.update (pack, Fleet::Column::CellDelta, *maximum - *minimum);
+        fleet.update (pack, Fleet::Column::SensorMax, static_cast<float> (20 + random () % 22));
+        fleet.update (pack, Fleet::Column::Charge, static_cast<float> (random () % 1000) / 10.0f);
+    }
+    const auto bench = [] (const char *name, auto &&query) {
+        const unsigned long benched = micros ();
+        size_t iterations = 0, result = 0;
+        while (micros () - benched < 200000)
+            result = query (), iterations++;
+        DEBUG_PRINTF ("fleet: %s: %.2fus per query over 1000 packs, %u found\n", name, static_cast<double> (micros () - benched) / iterations, static_cast<unsigned> (result));
+    };
+    bench ("worst 10 cell deltas", [&] {
+        std::array<size_t, 10> packs;
+        return fleet.topK (Fleet::Column::CellDelta, packs.size (), packs.data ());
+    });
+    bench ("sensors over 40C", [&] {
+        std::array<size_t, 64> packs;
+        return fleet.scan (Fleet::Column::SensorMax, 40.0f, packs.data (), packs.size ());
+    });
+    bench ("charge histogram", [&] {
+        std::array<counter_t, 20> bins;
+        return fleet.histogram (Fleet::Column::Charge, 0.0f, 100.0f, bins);
+    });
+    bench ("cells over 3.39V", [&] {
+        return fleet.scanCells (3.39f, [] (size_t, size_t, float) { });
+    });
+
+    const float *deltas = fleet.column (Fleet::Column::CellDelta), *sensors = fleet.column (Fleet::Column::SensorMax), *charges = fleet.column (Fleet::Column::Charge);
+    std::vector<size_t> order (fleet.packs ());
+    for (size_t pack = 0; pack < order.size (); pack++)
+        order [pack] = pack;
+    std::stable_sort (order.begin (), order.end (), [&] (const size_t a, const size_t b) { return deltas [a] > deltas [b]; });
+    std::array<size_t, 10> worst;
+    const size_t ranked = fleet.topK (Fleet::Column::CellDelta, worst.size (), worst.data ());
+    bool sorted = ranked == worst.size ();
+    for (size_t i = 0; sorted && i < ranked; i++)
+        sorted = deltas [worst [i]] == deltas [order [i]];
+    check ("fleet", sorted && worst [0] == 0, "the worst deltas as a full sort finds them, the attached pack first");
+    size_t hot = 0, charged = 0;
+    for (size_t pack = 0; pack < fleet.packs (); pack++)
+        hot += sensors [pack] > 40.0f ? 1 : 0, charged += std::isnan (charges [pack]) ? 0 : 1;
+    std::array<size_t, 64> found {};
+    check ("fleet", fleet.scan (Fleet::Column::SensorMax, 40.0f, found.data (), found.size ()) == hot && found [0] == 0, "every sensor over the threshold, the attached pack first");
+    std::array<counter_t, 20> bins;
+    const size_t binned = fleet.histogram (Fleet::Column::Charge, 0.0f, 100.0f, bins);
+    size_t summed = 0;
+    for (const auto bin : bins)
+        summed += bin;
+    check ("fleet", binned == charged && summed == charged, "every known charge in some bin");
+    bool attached = false;
+    fleet.scanCells (3.49f, [&] (const size_t pack, const size_t cell, float) { attached |= pack == 0 && cell == 3; });
+    check ("fleet", attached, "the attached pack's high cell found by the cell scan");
+    manager.end ();
+}
+
+// -----------------------------------------------------------------------------------------------
+
 Intervalable processInterval (5 * 1000), requestStatus (15 * 1000), requestDiagnostics (30 * 1000), reportData (30 * 1000);
 
 daly_bms::Interfaces *dalyInterfaces { nullptr };
@@ -216,6 +1187,26 @@ void dalybms_setup () {
 
     // testRaw ();
     // testOne ();
+    // testDecoding ();
+    // testSizes ();
+    // testSubscriptions ();
+    // testFlowControl ();
+    // testCalibration ();
+    // testDiscovery ();
+    // testCache ();
+    // testStartup ();
+    // testFreshness ();
+    // testPolling ();
+    // testRecorder ();
+    // testAlarms ();
+    // testThresholds ();
+    // testRules ();
+    // testSnapshot ();
+    // testFusion ();
+    // testBank ();
+    // testFleet ();
+    if (checksFailed > 0)
+        DEBUG_PRINTF ("*** %d CHECKS FAILED\n", checksFailed);
     testTwo ();
 
     // clang-format off